@@ -151,4 +151,29 @@ extern void __cmpxchg_wrong_size(void);
 	cmpxchg_local((ptr), (o), (n));					\
 })
 
+/*
+ * Atomically compare and exchange the two adjacent words at @ptr, which
+ * must be 16 byte aligned. Returns true if both words matched @o1 and
+ * @o2 and were replaced by @n1 and @n2.
+ */
+#define cmpxchg_double(ptr, o1, o2, n1, n2)				\
+({									\
+	char __ret;							\
+	__typeof__(o2) __junk;						\
+	__typeof__(*(ptr)) __old1 = (o1);				\
+	__typeof__(o2) __old2 = (o2);					\
+	__typeof__(*(ptr)) __new1 = (n1);				\
+	__typeof__(o2) __new2 = (n2);					\
+	BUILD_BUG_ON(sizeof(*(ptr)) != 8);				\
+	BUILD_BUG_ON(sizeof(o2) != 8);					\
+	asm volatile(LOCK_PREFIX "cmpxchg16b %2; setz %1"		\
+		     : "=d" (__junk), "=a" (__ret), "+m" (*(ptr))	\
+		     : "b" (__new1), "c" (__new2),			\
+		       "a" (__old1), "d" (__old2)			\
+		     : "memory");					\
+	__ret;								\
+})
+
+#define system_has_cmpxchg_double() cpu_has_cx16
+
 #endif /* _ASM_X86_CMPXCHG_64_H */
@@ -20,6 +20,7 @@
  * are available. The use of 0x11 and 0x12 is deprecated
  */
 #define KVM_FEATURE_CLOCKSOURCE2        3
+#define KVM_FEATURE_ASYNC_PF		4
 
 /* The last 8 bits are used to indicate how to interpret the flags field
  * in pvclock structure. If no bits are set, all flags are ignored.
@@ -32,6 +33,7 @@
 /* Custom MSRs falls in the range 0x4b564d00-0x4b564dff */
 #define MSR_KVM_WALL_CLOCK_NEW  0x4b564d00
 #define MSR_KVM_SYSTEM_TIME_NEW 0x4b564d01
+#define MSR_KVM_ASYNC_PF_EN	0x4b564d02
 
 #define KVM_MAX_MMU_OP_BATCH           32
 
@@ -61,6 +63,26 @@ struct kvm_mmu_op_release_pt {
 	__u64 pt_phys;
 };
 
+/*
+ * MSR_KVM_ASYNC_PF_EN holds the guest physical address of a 64 byte
+ * aligned struct kvm_vcpu_pv_apf_data, or'ed with the flags below.
+ */
+#define KVM_ASYNC_PF_ENABLED			(1 << 0)
+#define KVM_ASYNC_PF_SEND_ALWAYS		(1 << 1)
+
+/*
+ * Reason for an async page fault, written by the host before it injects
+ * a #PF whose cr2 holds the token identifying the fault.
+ */
+#define KVM_PV_REASON_PAGE_NOT_PRESENT 1
+#define KVM_PV_REASON_PAGE_READY 2
+
+struct kvm_vcpu_pv_apf_data {
+	__u32 reason;
+	__u8 pad[60];
+	__u32 enabled;
+};
+
 #ifdef __KERNEL__
 #include <asm/processor.h>
 
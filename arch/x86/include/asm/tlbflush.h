@@ -68,6 +68,28 @@ static inline void __flush_tlb_one(unsigned long addr)
 # define TLB_FLUSH_ALL	-1ULL
 #endif
 
+/*
+ * Up to this many kernel pages are flushed one by one with INVLPG;
+ * anything larger throws away the whole TLB including the global
+ * kernel entries.
+ */
+#define TLB_KERNEL_RANGE_PAGES	32
+
+static inline void __flush_tlb_kernel_range(unsigned long start,
+					    unsigned long end)
+{
+	unsigned long addr;
+
+	if (!cpu_has_invlpg || end <= start ||
+	    end - start > TLB_KERNEL_RANGE_PAGES * PAGE_SIZE) {
+		__flush_tlb_all();
+		return;
+	}
+
+	for (addr = start & PAGE_MASK; addr < end; addr += PAGE_SIZE)
+		__flush_tlb_single(addr);
+}
+
 /*
  * TLB flushing:
  *
@@ -83,8 +105,8 @@ static inline void __flush_tlb_one(unsigned long addr)
  * and page-granular flushes are available only on i486 and up.
  *
  * x86-64 can only flush individual pages or full VMs. For a range flush
- * we always do the full VM. Might be worth trying if for a small
- * range a few INVLPGs in a row are a win.
+ * of user pages we always do the full VM; small kernel ranges are
+ * flushed with a few INVLPGs in a row (see __flush_tlb_kernel_range).
  */
 
 #ifndef CONFIG_SMP
@@ -113,6 +135,12 @@ static inline void flush_tlb_range(struct vm_area_struct *vma,
 		__flush_tlb();
 }
 
+static inline void flush_tlb_kernel_range(unsigned long start,
+					  unsigned long end)
+{
+	__flush_tlb_kernel_range(start, end);
+}
+
 static inline void native_flush_tlb_others(const struct cpumask *cpumask,
 					   struct mm_struct *mm,
 					   unsigned long va)
@@ -133,6 +161,7 @@ extern void flush_tlb_all(void);
 extern void flush_tlb_current_task(void);
 extern void flush_tlb_mm(struct mm_struct *);
 extern void flush_tlb_page(struct vm_area_struct *, unsigned long);
+extern void flush_tlb_kernel_range(unsigned long start, unsigned long end);
 
 #define flush_tlb()	flush_tlb_current_task()
 
@@ -166,12 +195,6 @@ static inline void reset_lazy_tlbstate(void)
 #define flush_tlb_others(mask, mm, va)	native_flush_tlb_others(mask, mm, va)
 #endif
 
-static inline void flush_tlb_kernel_range(unsigned long start,
-					  unsigned long end)
-{
-	flush_tlb_all();
-}
-
 extern void zap_low_mappings(bool early);
 
 #endif /* _ASM_X86_TLBFLUSH_H */
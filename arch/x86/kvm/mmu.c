@@ -21,6 +21,7 @@
 #include "mmu.h"
 #include "x86.h"
 #include "kvm_cache_regs.h"
+#include "irq.h"
 
 #include <linux/kvm_host.h>
 #include <linux/types.h>
@@ -2127,6 +2128,54 @@ static int kvm_handle_bad_page(struct kvm *kvm, gfn_t gfn, pfn_t pfn)
 	return 1;
 }
 
+static bool can_do_async_pf(struct kvm_vcpu *vcpu)
+{
+	if (!(vcpu->arch.apf.msr_val & KVM_ASYNC_PF_ENABLED))
+		return false;
+
+	if (unlikely(!irqchip_in_kernel(vcpu->kvm) ||
+		     kvm_event_needs_reinjection(vcpu)))
+		return false;
+
+	if (vcpu->arch.apf.send_user_only &&
+	    kvm_x86_ops->get_cpl(vcpu) == 0)
+		return false;
+
+	return kvm_x86_ops->interrupt_allowed(vcpu);
+}
+
+static int kvm_arch_setup_async_pf(struct kvm_vcpu *vcpu, gfn_t gfn)
+{
+	struct kvm_arch_async_pf arch;
+
+	arch.token = (vcpu->arch.apf.id++ << 12) | vcpu->vcpu_id;
+	arch.gfn = gfn;
+
+	return kvm_setup_async_pf(vcpu, gfn, &arch);
+}
+
+/*
+ * Look up the host page backing @gfn.  If it is not resident and the guest
+ * accepts async page faults, queue the fault and return true: the guest
+ * has been told the page is not present and will retry the access once
+ * it is ready.  Otherwise fault it in synchronously into *pfn.
+ */
+static bool try_async_pf(struct kvm_vcpu *vcpu, gfn_t gfn, pfn_t *pfn)
+{
+	bool async;
+
+	if (can_do_async_pf(vcpu)) {
+		*pfn = gfn_to_pfn_async(vcpu->kvm, gfn, &async);
+		if (!async)
+			return false;
+		if (kvm_arch_setup_async_pf(vcpu, gfn))
+			return true;
+	}
+
+	*pfn = gfn_to_pfn(vcpu->kvm, gfn);
+	return false;
+}
+
 static int nonpaging_map(struct kvm_vcpu *vcpu, gva_t v, int write, gfn_t gfn)
 {
 	int r;
@@ -2147,7 +2196,9 @@ static int nonpaging_map(struct kvm_vcpu *vcpu, gva_t v, int write, gfn_t gfn)
 
 	mmu_seq = vcpu->kvm->mmu_notifier_seq;
 	smp_rmb();
-	pfn = gfn_to_pfn(vcpu->kvm, gfn);
+
+	if (try_async_pf(vcpu, gfn, &pfn))
+		return 0;
 
 	/* mmio */
 	if (is_error_pfn(pfn))
@@ -2369,7 +2420,10 @@ static int tdp_page_fault(struct kvm_vcpu *vcpu, gva_t gpa,
 
 	mmu_seq = vcpu->kvm->mmu_notifier_seq;
 	smp_rmb();
-	pfn = gfn_to_pfn(vcpu->kvm, gfn);
+
+	if (try_async_pf(vcpu, gfn, &pfn))
+		return 0;
+
 	if (is_error_pfn(pfn))
 		return kvm_handle_bad_page(vcpu->kvm, gfn, pfn);
 	spin_lock(&vcpu->kvm->mmu_lock);
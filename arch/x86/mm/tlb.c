@@ -287,3 +287,25 @@ void flush_tlb_all(void)
 {
 	on_each_cpu(do_flush_tlb_all, NULL, 1);
 }
+
+struct flush_kernel_range {
+	unsigned long start;
+	unsigned long end;
+};
+
+static void do_flush_tlb_kernel_range(void *info)
+{
+	struct flush_kernel_range *range = info;
+
+	__flush_tlb_kernel_range(range->start, range->end);
+}
+
+void flush_tlb_kernel_range(unsigned long start, unsigned long end)
+{
+	struct flush_kernel_range range = {
+		.start	= start,
+		.end	= end,
+	};
+
+	on_each_cpu(do_flush_tlb_kernel_range, &range, 1);
+}
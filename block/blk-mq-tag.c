@@ -0,0 +1,116 @@
+/*
+ * Tag allocation for multiqueue hardware queues
+ *
+ * Every hardware queue owns a fixed set of preallocated requests, and
+ * the tag of a request is its index in that set.  Free tags are tracked
+ * in a bitmap; each cpu remembers where its last allocation succeeded
+ * and starts searching from there, so that cpus sharing a hardware
+ * queue mostly work on different words of the bitmap.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+
+#include "blk-mq-tag.h"
+
+struct blk_mq_tags {
+	unsigned int nr_tags;
+	unsigned int __percpu *hint;	/* where to start looking */
+	wait_queue_head_t wait;		/* tasks waiting for a free tag */
+	unsigned long map[0];		/* set bit == tag in use */
+};
+
+static unsigned int __blk_mq_find_tag(unsigned long *map, unsigned int start,
+				      unsigned int end)
+{
+	unsigned int tag = start;
+
+	while ((tag = find_next_zero_bit(map, end, tag)) < end) {
+		if (!test_and_set_bit(tag, map))
+			return tag;
+		tag++;
+	}
+
+	return BLK_MQ_TAG_FAIL;
+}
+
+/*
+ * Grab a free tag without sleeping, returns BLK_MQ_TAG_FAIL if all of
+ * them are in use.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags)
+{
+	unsigned int start, tag;
+
+	start = this_cpu_read(*tags->hint);
+	if (start >= tags->nr_tags)
+		start = 0;
+
+	tag = __blk_mq_find_tag(tags->map, start, tags->nr_tags);
+	if (tag == BLK_MQ_TAG_FAIL && start)
+		tag = __blk_mq_find_tag(tags->map, 0, start);
+
+	if (tag != BLK_MQ_TAG_FAIL)
+		this_cpu_write(*tags->hint, tag + 1);
+
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit(tag, tags->map);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+static bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
+{
+	return find_first_zero_bit(tags->map, tags->nr_tags) < tags->nr_tags;
+}
+
+/*
+ * Sleep until a tag has been freed.  The caller must retry the
+ * allocation, since someone else may have grabbed it in the meantime.
+ */
+void blk_mq_wait_for_tags(struct blk_mq_tags *tags)
+{
+	DEFINE_WAIT(wait);
+
+	prepare_to_wait(&tags->wait, &wait, TASK_UNINTERRUPTIBLE);
+	if (!blk_mq_has_free_tags(tags))
+		io_schedule();
+	finish_wait(&tags->wait, &wait);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node)
+{
+	struct blk_mq_tags *tags;
+
+	tags = kzalloc_node(sizeof(*tags) +
+			    BITS_TO_LONGS(nr_tags) * sizeof(unsigned long),
+			    GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->hint) {
+		kfree(tags);
+		return NULL;
+	}
+
+	tags->nr_tags = nr_tags;
+	init_waitqueue_head(&tags->wait);
+	return tags;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->hint);
+	kfree(tags);
+}
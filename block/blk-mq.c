@@ -0,0 +1,774 @@
+/*
+ * Multiqueue block layer core
+ *
+ * Requests are staged on a software queue (struct blk_mq_ctx) private to
+ * the submitting cpu, so the submission path never bounces a lock
+ * between cpus.  Running a hardware queue collects the requests from
+ * the software queues mapped to it and hands them to ->queue_rq().
+ * There is no elevator and no merging; devices that want this are fast
+ * enough that the cost of sorting outweighs what it buys.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/cpumask.h>
+#include <linux/sched.h>
+#include <linux/delay.h>
+#include <linux/blk-mq.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-tag.h"
+
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return per_cpu_ptr(q->queue_ctx, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+/*
+ * Queue usage counting.  Every allocated request holds a reference on
+ * the queue, taken on the local cpu under preempt_disable().  Freezing
+ * the queue stops new references from being taken; once every cpu has
+ * been through a quiescent state the sum of the per-cpu counts can only
+ * go down, and the queue is idle when it reaches zero.
+ */
+static int blk_mq_queue_enter(struct request_queue *q, gfp_t gfp)
+{
+	for (;;) {
+		preempt_disable();
+		if (likely(!ACCESS_ONCE(q->mq_freeze_depth))) {
+			irqsafe_cpu_inc(*q->mq_usage);
+			preempt_enable();
+			return 0;
+		}
+		preempt_enable();
+
+		if (!(gfp & __GFP_WAIT))
+			return -EBUSY;
+
+		wait_event(q->mq_freeze_wq,
+			   !ACCESS_ONCE(q->mq_freeze_depth) || blk_queue_dead(q));
+		if (blk_queue_dead(q))
+			return -ENODEV;
+	}
+}
+
+static void blk_mq_queue_exit(struct request_queue *q)
+{
+	irqsafe_cpu_dec(*q->mq_usage);
+
+	/*
+	 * Pairs with the barrier in synchronize_sched() in the freezer,
+	 * either it sees our decrement or we see it freezing.
+	 */
+	smp_mb();
+	if (unlikely(ACCESS_ONCE(q->mq_freeze_depth)))
+		wake_up_all(&q->mq_freeze_wq);
+}
+
+static int blk_mq_queue_usage(struct request_queue *q)
+{
+	int cpu, sum = 0;
+
+	for_each_possible_cpu(cpu)
+		sum += *per_cpu_ptr(q->mq_usage, cpu);
+
+	return sum;
+}
+
+static void blk_mq_freeze_queue(struct request_queue *q)
+{
+	spin_lock_irq(q->queue_lock);
+	q->mq_freeze_depth++;
+	spin_unlock_irq(q->queue_lock);
+
+	synchronize_sched();
+	wait_event(q->mq_freeze_wq, !blk_mq_queue_usage(q));
+}
+
+static void blk_mq_unfreeze_queue(struct request_queue *q)
+{
+	bool wake;
+
+	spin_lock_irq(q->queue_lock);
+	wake = !--q->mq_freeze_depth;
+	spin_unlock_irq(q->queue_lock);
+
+	if (wake)
+		wake_up_all(&q->mq_freeze_wq);
+}
+
+/*
+ * Called with the queue marked dead, fails anyone waiting for the queue
+ * to be unfrozen.
+ */
+void blk_mq_mark_dead(struct request_queue *q)
+{
+	wake_up_all(&q->mq_freeze_wq);
+}
+
+static void blk_mq_rq_ctx_init(struct request_queue *q,
+			       struct blk_mq_ctx *ctx, struct request *rq,
+			       unsigned int rw_flags, unsigned int tag)
+{
+	blk_rq_init(q, rq);
+	rq->mq_ctx = ctx;
+	rq->tag = tag;
+	rq->cmd_flags = rw_flags;
+}
+
+/*
+ * Allocate a request from the hardware queue of the local cpu.  The
+ * caller must hold a queue reference, which the request takes over.
+ */
+static struct request *__blk_mq_alloc_request(struct request_queue *q,
+					      unsigned int rw_flags, gfp_t gfp)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	unsigned int tag;
+
+	for (;;) {
+		ctx = blk_mq_get_ctx(q);
+		hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+		tag = blk_mq_get_tag(hctx->tags);
+		if (tag != BLK_MQ_TAG_FAIL) {
+			rq = hctx->rqs[tag];
+			blk_mq_rq_ctx_init(q, ctx, rq, rw_flags, tag);
+			blk_mq_put_ctx(ctx);
+			return rq;
+		}
+		blk_mq_put_ctx(ctx);
+
+		if (!(gfp & __GFP_WAIT))
+			return NULL;
+
+		blk_mq_wait_for_tags(hctx->tags);
+	}
+}
+
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp)
+{
+	struct request *rq;
+
+	if (blk_mq_queue_enter(q, gfp))
+		return NULL;
+
+	rq = __blk_mq_alloc_request(q, rw, gfp);
+	if (!rq)
+		blk_mq_queue_exit(q);
+
+	return rq;
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+
+	/* this is a bio leak */
+	WARN_ON(rq->bio != NULL);
+
+	rq->cmd_flags = 0;
+	blk_mq_put_tag(hctx->tags, rq->tag);
+	blk_mq_queue_exit(q);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - complete a request in full
+ * @rq:		the request being completed
+ * @error:	%0 for success, < %0 for error
+ *
+ * Description:
+ *     Ends all I/O on the request and releases it, or passes it to
+ *     ->end_io if the submitter set one.  Unlike blk_end_request_all(),
+ *     this takes no lock and may be called from any context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+/*
+ * Run this hardware queue, pulling in the software queues mapped to it.
+ * Runs may happen concurrently on several cpus; ->queue_rq() has to
+ * cope with that.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	/*
+	 * Previously requeued requests go first, then whatever the
+	 * software queues have collected.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		trace_block_rq_issue(q, rq);
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK)
+			continue;
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		WARN_ON_ONCE(ret != BLK_MQ_RQ_QUEUE_ERROR);
+		blk_mq_end_io(rq, -EIO);
+	}
+
+	if (list_empty(&rq_list))
+		return;
+
+	/*
+	 * The device is busy, park the rest on the dispatch list.  The
+	 * driver should have stopped the queue, and restarting it runs
+	 * the queue again; if it was restarted before we got here, or
+	 * the driver didn't stop it at all, retry shortly.
+	 */
+	spin_lock(&hctx->lock);
+	list_splice(&rq_list, &hctx->dispatch);
+	spin_unlock(&hctx->lock);
+
+	smp_mb();
+	if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+		kblockd_schedule_delayed_work(q, &hctx->delayed_work,
+					      msecs_to_jiffies(3));
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch pending requests of a hardware queue
+ * @hctx:	the hardware queue
+ * @async:	defer to kblockd rather than run from the caller's context
+ *
+ * Description:
+ *     A synchronous run calls ->queue_rq() directly and must only be done
+ *     from process context.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async)
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue,
+					      &hctx->delayed_work, 0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->delayed_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+/*
+ * Restart a stopped hardware queue and run it synchronously, so this
+ * must be called from process context.
+ */
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+/*
+ * Restart all stopped hardware queues of @q.  They are run from kblockd,
+ * so this is safe to call from the driver's completion interrupt.
+ */
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		smp_mb__after_clear_bit();
+		blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, delayed_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq, bool at_head)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	spin_lock(&ctx->lock);
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	spin_unlock(&ctx->lock);
+
+	set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+/**
+ * blk_mq_insert_request - queue a request allocated by the caller
+ * @q:		the request queue
+ * @rq:		request from blk_mq_alloc_request()
+ * @at_head:	insert at the head of the software queue
+ * @run_queue:	run the hardware queue right away
+ *
+ * Description:
+ *     This is what blk_execute_rq_nowait() ends up in for multiqueue
+ *     devices.  Must be called from process context.
+ */
+void blk_mq_insert_request(struct request_queue *q, struct request *rq,
+			   bool at_head, bool run_queue)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+
+	__blk_mq_insert_request(hctx, rq, at_head);
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+/*
+ * Barrier support.  Multiqueue devices have no single dispatch point at
+ * which requests could be ordered, so a barrier drains the whole queue
+ * by freezing it, then issues the flush/barrier/flush sequence selected
+ * by blk_queue_ordered() one request at a time.
+ */
+static struct request *blk_mq_alloc_frozen_request(struct request_queue *q,
+						   unsigned int rw_flags)
+{
+	/* the queue is frozen by us, take the reference unconditionally */
+	irqsafe_cpu_inc(*q->mq_usage);
+	return __blk_mq_alloc_request(q, rw_flags, GFP_NOIO);
+}
+
+static void blk_mq_end_sync_rq(struct request *rq, int error)
+{
+	struct completion *waiting = rq->end_io_data;
+
+	rq->errors = error;
+	complete(waiting);
+}
+
+static int blk_mq_execute_frozen(struct request_queue *q, struct request *rq)
+{
+	DECLARE_COMPLETION_ONSTACK(wait);
+	int err;
+
+	rq->end_io = blk_mq_end_sync_rq;
+	rq->end_io_data = &wait;
+	blk_mq_insert_request(q, rq, true, true);
+	wait_for_completion(&wait);
+
+	err = rq->errors;
+	blk_mq_free_request(rq);
+	return err;
+}
+
+static int blk_mq_flush(struct request_queue *q, struct gendisk *disk)
+{
+	struct request *rq;
+
+	rq = blk_mq_alloc_frozen_request(q, 0);
+	rq->cmd_type = REQ_TYPE_FS;
+	rq->cmd_flags = REQ_HARDBARRIER | REQ_FLUSH;
+	rq->rq_disk = disk;
+
+	return blk_mq_execute_frozen(q, rq);
+}
+
+static void blk_mq_barrier(struct request_queue *q, struct bio *bio)
+{
+	struct gendisk *disk = bio->bi_bdev->bd_disk;
+	unsigned int ordered = q->next_ordered;
+	struct request *rq;
+	int err = 0;
+
+	if (ordered == QUEUE_ORDERED_NONE) {
+		bio_endio(bio, -EOPNOTSUPP);
+		return;
+	}
+
+	blk_queue_bounce(q, &bio);
+
+	/* an empty barrier is just a cache flush */
+	if (!bio_has_data(bio))
+		ordered &= ~(QUEUE_ORDERED_DO_BAR | QUEUE_ORDERED_DO_POSTFLUSH);
+
+	mutex_lock(&q->mq_ordered_mutex);
+	blk_mq_freeze_queue(q);
+
+	if (ordered & QUEUE_ORDERED_DO_PREFLUSH)
+		err = blk_mq_flush(q, disk);
+
+	if (!err && (ordered & QUEUE_ORDERED_DO_BAR)) {
+		rq = blk_mq_alloc_frozen_request(q, bio_data_dir(bio));
+		init_request_from_bio(rq, bio);
+		if (ordered & QUEUE_ORDERED_DO_FUA)
+			rq->cmd_flags |= REQ_FUA;
+
+		/*
+		 * The request is only a proxy, req_bio_endio() records the
+		 * error in ->orderr and leaves the bio to us.
+		 */
+		q->orderr = 0;
+		q->mq_bar_rq = rq;
+		err = blk_mq_execute_frozen(q, rq);
+		q->mq_bar_rq = NULL;
+		if (!err)
+			err = q->orderr;
+	}
+
+	if (!err && (ordered & QUEUE_ORDERED_DO_POSTFLUSH))
+		err = blk_mq_flush(q, disk);
+
+	blk_mq_unfreeze_queue(q);
+	mutex_unlock(&q->mq_ordered_mutex);
+
+	bio_endio(bio, err);
+}
+
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const bool sync = !!(bio->bi_rw & REQ_SYNC);
+	const bool unplug = !!(bio->bi_rw & REQ_UNPLUG);
+	struct blk_mq_hw_ctx *hctx;
+	struct request *rq;
+	int rw_flags;
+
+	if (unlikely(bio->bi_rw & REQ_HARDBARRIER)) {
+		blk_mq_barrier(q, bio);
+		return 0;
+	}
+
+	blk_queue_bounce(q, &bio);
+
+	if (unlikely(blk_mq_queue_enter(q, GFP_NOIO))) {
+		bio_endio(bio, -EIO);
+		return 0;
+	}
+
+	rw_flags = bio_data_dir(bio);
+	if (sync)
+		rw_flags |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, rw_flags & 1);
+	rq = __blk_mq_alloc_request(q, rw_flags, GFP_NOIO);
+	init_request_from_bio(rq, bio);
+
+	hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+	__blk_mq_insert_request(hctx, rq, false);
+
+	/*
+	 * Reads and sync writes are dispatched right away, async writes
+	 * are left for kblockd so that a few of them get batched.
+	 */
+	blk_mq_run_hw_queue(hctx, !(rw_is_sync(rw_flags) || unplug));
+	return 0;
+}
+
+static void blk_mq_unplug(struct request_queue *q)
+{
+	blk_mq_run_queues(q, false);
+}
+
+/*
+ * Default cpu to hardware queue mapping: consecutive cpus share a
+ * queue, which tends to keep cores of the same package together.
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+}
+
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      unsigned int depth, unsigned int cmd_size)
+{
+	size_t rq_size = sizeof(struct request) + cmd_size;
+	unsigned int i;
+
+	hctx->rqs = kzalloc_node(depth * sizeof(struct request *),
+				 GFP_KERNEL, hctx->numa_node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	for (i = 0; i < depth; i++) {
+		hctx->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL,
+					    hctx->numa_node);
+		if (!hctx->rqs[i])
+			break;
+	}
+	hctx->queue_depth = i;
+
+	if (i < depth)
+		return -ENOMEM;
+
+	hctx->tags = blk_mq_init_tags(depth, hctx->numa_node);
+	if (!hctx->tags)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int i, j;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, reg->numa_node);
+		if (!hctx)
+			return -ENOMEM;
+
+		q->queue_hw_ctx[i] = hctx;
+		q->nr_hw_queues++;
+
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		INIT_DELAYED_WORK(&hctx->delayed_work, blk_mq_work_fn);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->driver_data = driver_data;
+		hctx->numa_node = reg->numa_node;
+
+		if (!zalloc_cpumask_var(&hctx->cpumask, GFP_KERNEL))
+			return -ENOMEM;
+	}
+
+	for_each_possible_cpu(i)
+		q->mq_map[i] = i * reg->nr_hw_queues / nr_cpu_ids;
+
+	/*
+	 * Count the software queues feeding each hardware queue first, so
+	 * that the per hardware queue arrays can be sized.
+	 */
+	for_each_possible_cpu(i) {
+		ctx = per_cpu_ptr(q->queue_ctx, i);
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = i;
+		ctx->queue = q;
+
+		hctx = q->mq_ops->map_queue(q, i);
+		cpumask_set_cpu(i, hctx->cpumask);
+		hctx->nr_ctx++;
+	}
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		hctx->ctxs = kmalloc_node(hctx->nr_ctx * sizeof(void *),
+					  GFP_KERNEL, hctx->numa_node);
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(hctx->nr_ctx) *
+					     sizeof(unsigned long),
+					     GFP_KERNEL, hctx->numa_node);
+		if (!hctx->ctxs || !hctx->ctx_map)
+			return -ENOMEM;
+
+		if (blk_mq_init_rq_map(hctx, reg->queue_depth, reg->cmd_size))
+			return -ENOMEM;
+
+		hctx->nr_ctx = 0;
+	}
+
+	for_each_possible_cpu(j) {
+		ctx = per_cpu_ptr(q->queue_ctx, j);
+		hctx = q->mq_ops->map_queue(q, j);
+
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+
+	return 0;
+}
+
+/**
+ * blk_mq_init_queue - allocate a multiqueue request queue
+ * @reg:	hardware queue layout and driver operations
+ * @driver_data: stored in ->queuedata and in every hctx->driver_data
+ *
+ * Description:
+ *     Sets up one software queue per possible cpu and @reg->nr_hw_queues
+ *     hardware queues of @reg->queue_depth preallocated requests each,
+ *     with @reg->cmd_size bytes of driver data behind every request (see
+ *     blk_mq_rq_to_pdu()).  The queue is released with
+ *     blk_cleanup_queue() like any other.
+ *
+ *     Returns %NULL on failure.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct request_queue *q;
+
+	if (!reg->nr_hw_queues || !reg->queue_depth ||
+	    !reg->ops->queue_rq || !reg->ops->map_queue)
+		return NULL;
+
+	if (reg->queue_depth > BLK_MQ_MAX_DEPTH) {
+		printk(KERN_ERR "blk-mq: queue depth too large (%u), "
+		       "reduced to %u\n", reg->queue_depth, BLK_MQ_MAX_DEPTH);
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return NULL;
+
+	/*
+	 * From here on blk_cleanup_queue() cleans up whatever has been
+	 * set up so far.
+	 */
+	q->mq_ops = reg->ops;
+	q->queuedata = driver_data;
+	init_waitqueue_head(&q->mq_freeze_wq);
+	mutex_init(&q->mq_ordered_mutex);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->unplug_fn = blk_mq_unplug;
+	queue_flag_set_unlocked(QUEUE_FLAG_NOMERGES, q);
+
+	q->mq_usage = alloc_percpu(int);
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->mq_map = kzalloc_node(nr_cpu_ids * sizeof(unsigned int),
+				 GFP_KERNEL, reg->numa_node);
+	q->queue_hw_ctx = kzalloc_node(reg->nr_hw_queues * sizeof(void *),
+				       GFP_KERNEL, reg->numa_node);
+	if (!q->mq_usage || !q->queue_ctx || !q->mq_map || !q->queue_hw_ctx)
+		goto err;
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err;
+
+	return q;
+err:
+	blk_cleanup_queue(q);
+	return NULL;
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Cancel any pending run of the hardware queues, see blk_sync_queue()
+ */
+void blk_mq_sync_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		cancel_delayed_work_sync(&hctx->delayed_work);
+}
+
+/*
+ * Called on the final put of the queue
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		blk_mq_free_rq_map(hctx);
+		kfree(hctx->ctxs);
+		kfree(hctx->ctx_map);
+		free_cpumask_var(hctx->cpumask);
+		kfree(hctx);
+	}
+
+	kfree(q->queue_hw_ctx);
+	kfree(q->mq_map);
+	free_percpu(q->queue_ctx);
+	free_percpu(q->mq_usage);
+}
@@ -273,6 +273,7 @@ static int macvtap_open(struct inode *inode, struct file *file)
 {
 	struct net *net = current->nsproxy->net_ns;
 	struct net_device *dev = dev_get_by_index(net, iminor(inode));
+	struct macvlan_dev *vlan;
 	struct macvtap_queue *q;
 	int err;
 
@@ -302,6 +303,16 @@ static int macvtap_open(struct inode *inode, struct file *file)
 	q->flags = IFF_VNET_HDR | IFF_NO_PI | IFF_TAP;
 	q->vnet_hdr_sz = sizeof(struct virtio_net_hdr);
 
+	/*
+	 * Senders that pass a ubuf_info in msg_control (vhost-net) may have
+	 * their buffers attached to the skb instead of copied, if the lower
+	 * device can do scatter-gather DMA from any page.
+	 */
+	vlan = netdev_priv(dev);
+	if ((vlan->lowerdev->features & NETIF_F_HIGHDMA) &&
+	    (vlan->lowerdev->features & NETIF_F_SG))
+		sock_set_flag(&q->sk, SOCK_ZEROCOPY);
+
 	err = macvtap_set_queue(dev, file, q);
 	if (err)
 		sock_put(&q->sk);
@@ -343,6 +354,9 @@ out:
 	return mask;
 }
 
+/* Minimum number of bytes of a zero-copy packet copied into the linear part */
+#define GOODCOPY_LEN 128
+
 static inline struct sk_buff *macvtap_alloc_skb(struct sock *sk, size_t prepad,
 						size_t len, size_t linear,
 						int noblock, int *err)
@@ -448,8 +462,111 @@ static int macvtap_skb_to_vnet_hdr(const struct sk_buff *skb,
 }
 
 
+/* Set skb frags from iovec: the first skb_headlen(skb) bytes past offset are
+ * copied into the linear part, the user pages holding the rest are pinned
+ * and attached as frags. */
+static int zerocopy_sg_from_iovec(struct sk_buff *skb, const struct iovec *from,
+				  int offset, size_t count)
+{
+	int len = iov_length(from, count) - offset;
+	int copy = skb_headlen(skb);
+	int size, offset1 = 0;
+	int i = 0;
+
+	/* Skip over from offset */
+	while (count && (offset >= from->iov_len)) {
+		offset -= from->iov_len;
+		++from;
+		--count;
+	}
+
+	/* copy up to skb headlen */
+	while (count && (copy > 0)) {
+		size = min_t(unsigned int, copy, from->iov_len - offset);
+		if (copy_from_user(skb->data + offset1, from->iov_base + offset,
+				   size))
+			return -EFAULT;
+		if (copy > size) {
+			++from;
+			--count;
+			offset = 0;
+		} else
+			offset += size;
+		copy -= size;
+		offset1 += size;
+	}
+
+	if (len == offset1)
+		return 0;
+
+	while (count--) {
+		struct page *page[MAX_SKB_FRAGS];
+		int num_pages, j;
+		unsigned long base;
+		unsigned long truesize;
+
+		len = from->iov_len - offset;
+		if (!len) {
+			offset = 0;
+			++from;
+			continue;
+		}
+		base = (unsigned long)from->iov_base + offset;
+		size = ((base & ~PAGE_MASK) + len + ~PAGE_MASK) >> PAGE_SHIFT;
+		if (i + size > MAX_SKB_FRAGS)
+			return -EMSGSIZE;
+		num_pages = get_user_pages_fast(base, size, 0, page);
+		if (num_pages != size) {
+			for (j = 0; j < num_pages; j++)
+				put_page(page[j]);
+			return -EFAULT;
+		}
+		truesize = size * PAGE_SIZE;
+		skb->data_len += len;
+		skb->len += len;
+		skb->truesize += truesize;
+		/* sock_wfree() will give back the larger truesize */
+		atomic_add(truesize, &skb->sk->sk_wmem_alloc);
+		for (j = 0; len; j++, i++) {
+			int off = base & ~PAGE_MASK;
+			int fsize = min_t(int, len, PAGE_SIZE - off);
+
+			skb_fill_page_desc(skb, i, page[j], off, fsize);
+			base += fsize;
+			len -= fsize;
+		}
+		offset = 0;
+		++from;
+	}
+	return 0;
+}
+
+/* Number of user pages spanned by the iovec from offset onwards */
+static unsigned long iov_pages(const struct iovec *iv, int offset,
+			       unsigned long nr_segs)
+{
+	unsigned long seg, base;
+	int pages = 0, len, size;
+
+	while (nr_segs && (offset >= iv->iov_len)) {
+		offset -= iv->iov_len;
+		++iv;
+		--nr_segs;
+	}
+
+	for (seg = 0; seg < nr_segs; seg++) {
+		base = (unsigned long)iv[seg].iov_base + offset;
+		len = iv[seg].iov_len - offset;
+		size = ((base & ~PAGE_MASK) + len + ~PAGE_MASK) >> PAGE_SHIFT;
+		pages += size;
+		offset = 0;
+	}
+
+	return pages;
+}
+
 /* Get packet from user space buffer */
-static ssize_t macvtap_get_user(struct macvtap_queue *q,
+static ssize_t macvtap_get_user(struct macvtap_queue *q, struct msghdr *m,
 				const struct iovec *iv, size_t count,
 				int noblock)
 {
@@ -459,6 +576,9 @@ static ssize_t macvtap_get_user(struct macvtap_queue *q,
 	int err;
 	struct virtio_net_hdr vnet_hdr = { 0 };
 	int vnet_hdr_len = 0;
+	size_t copylen;
+	bool zerocopy = false;
+	struct ubuf_info *uarg = m ? m->msg_control : NULL;
 
 	if (q->flags & IFF_VNET_HDR) {
 		vnet_hdr_len = q->vnet_hdr_sz;
@@ -485,12 +605,35 @@ static ssize_t macvtap_get_user(struct macvtap_queue *q,
 	if (unlikely(len < ETH_HLEN))
 		goto err;
 
-	skb = macvtap_alloc_skb(&q->sk, NET_IP_ALIGN, len, vnet_hdr.hdr_len,
-				noblock, &err);
+	if (uarg && sock_flag(&q->sk, SOCK_ZEROCOPY))
+		zerocopy = true;
+
+	if (zerocopy) {
+		/* Copy the headers (or a few cache lines) so that they can
+		 * be parsed and expanded in place; the rest stays in the
+		 * sender's pages. */
+		copylen = max_t(size_t, vnet_hdr.hdr_len, GOODCOPY_LEN);
+		if (copylen > len)
+			copylen = len;
+		/* Too many pages to attach as frags: copy the lot instead */
+		if (iov_pages(iv, vnet_hdr_len + copylen, m->msg_iovlen) >
+		    MAX_SKB_FRAGS)
+			zerocopy = false;
+	}
+	if (!zerocopy)
+		copylen = len;
+
+	skb = macvtap_alloc_skb(&q->sk, NET_IP_ALIGN, copylen,
+				vnet_hdr.hdr_len, noblock, &err);
 	if (!skb)
 		goto err;
 
-	err = skb_copy_datagram_from_iovec(skb, 0, iv, vnet_hdr_len, len);
+	if (zerocopy)
+		err = zerocopy_sg_from_iovec(skb, iv, vnet_hdr_len,
+					     m->msg_iovlen);
+	else
+		err = skb_copy_datagram_from_iovec(skb, 0, iv, vnet_hdr_len,
+						   len);
 	if (err)
 		goto err_kfree;
 
@@ -504,6 +647,14 @@ static ssize_t macvtap_get_user(struct macvtap_queue *q,
 			goto err_kfree;
 	}
 
+	if (zerocopy) {
+		skb_shinfo(skb)->destructor_arg = uarg;
+		skb_tx(skb)->dev_zerocopy = 1;
+	} else if (uarg) {
+		/* Copied: the sender's buffers are free to reuse already. */
+		uarg->callback(uarg);
+	}
+
 	rcu_read_lock_bh();
 	vlan = rcu_dereference(q->vlan);
 	if (vlan)
@@ -534,7 +685,7 @@ static ssize_t macvtap_aio_write(struct kiocb *iocb, const struct iovec *iv,
 	ssize_t result = -ENOLINK;
 	struct macvtap_queue *q = file->private_data;
 
-	result = macvtap_get_user(q, iv, iov_length(iv, count),
+	result = macvtap_get_user(q, NULL, iv, iov_length(iv, count),
 			      file->f_flags & O_NONBLOCK);
 	return result;
 }
@@ -748,7 +899,7 @@ static int macvtap_sendmsg(struct kiocb *iocb, struct socket *sock,
 			   struct msghdr *m, size_t total_len)
 {
 	struct macvtap_queue *q = container_of(sock, struct macvtap_queue, sock);
-	return macvtap_get_user(q, m->msg_iov, total_len,
+	return macvtap_get_user(q, m, m->msg_iov, total_len,
 			    m->msg_flags & MSG_DONTWAIT);
 }
 
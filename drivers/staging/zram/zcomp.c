@@ -0,0 +1,167 @@
+/*
+ * zram compression backends
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Any compressor registered with the crypto API ("lzo", "deflate", ...)
+ * can be used. Each device keeps a pool of compression streams, one per
+ * online CPU at initialization time, so that concurrent writers (and
+ * readers) do not serialize on a single shared workspace.
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+
+#include "zcomp.h"
+
+int zcomp_available(const char *name)
+{
+	return crypto_has_comp(name, 0, 0);
+}
+
+static void zcomp_strm_free(struct zcomp_strm *zstrm)
+{
+	if (zstrm->tfm && !IS_ERR(zstrm->tfm))
+		crypto_free_comp(zstrm->tfm);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->tfm = crypto_alloc_comp(comp->name, 0, 0);
+	/*
+	 * Allocate 2 pages: 1 for compressed data, plus 1 extra for the
+	 * case when compressed size is larger than the original one.
+	 */
+	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (IS_ERR(zstrm->tfm) || !zstrm->buffer) {
+		zcomp_strm_free(zstrm);
+		return NULL;
+	}
+	return zstrm;
+}
+
+void zcomp_destroy(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zcomp_strm, list);
+		list_del(&zstrm->list);
+		zcomp_strm_free(zstrm);
+	}
+	kfree(comp);
+}
+
+/*
+ * Create a compression backend using crypto algorithm @name with
+ * @nr_strms independent streams. Returns NULL on failure.
+ */
+struct zcomp *zcomp_create(const char *name, int nr_strms)
+{
+	struct zcomp *comp;
+	struct zcomp_strm *zstrm;
+	int i;
+
+	comp = kzalloc(sizeof(*comp), GFP_KERNEL);
+	if (!comp)
+		return NULL;
+
+	strlcpy(comp->name, name, sizeof(comp->name));
+	spin_lock_init(&comp->strm_lock);
+	INIT_LIST_HEAD(&comp->idle_strm);
+	init_waitqueue_head(&comp->strm_wait);
+
+	for (i = 0; i < nr_strms; i++) {
+		zstrm = zcomp_strm_alloc(comp);
+		if (!zstrm) {
+			zcomp_destroy(comp);
+			return NULL;
+		}
+		list_add(&zstrm->list, &comp->idle_strm);
+		comp->nr_strms++;
+	}
+	return comp;
+}
+
+static struct zcomp_strm *zcomp_strm_get(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm = NULL;
+
+	spin_lock(&comp->strm_lock);
+	if (!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zcomp_strm, list);
+		list_del(&zstrm->list);
+	}
+	spin_unlock(&comp->strm_lock);
+	return zstrm;
+}
+
+/*
+ * Get an idle stream, sleeping until one is released if all of them are
+ * busy. *waited is set if we had to sleep, for contention accounting.
+ */
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp, int *waited)
+{
+	struct zcomp_strm *zstrm;
+
+	*waited = 0;
+	while (!(zstrm = zcomp_strm_get(comp))) {
+		*waited = 1;
+		wait_event(comp->strm_wait, !list_empty(&comp->idle_strm));
+	}
+	return zstrm;
+}
+
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	spin_lock(&comp->strm_lock);
+	list_add(&zstrm->list, &comp->idle_strm);
+	spin_unlock(&comp->strm_lock);
+
+	if (waitqueue_active(&comp->strm_wait))
+		wake_up(&comp->strm_wait);
+}
+
+/*
+ * Compress one page from @src into zstrm->buffer. On return *dst_len
+ * holds the compressed length.
+ */
+int zcomp_compress(struct zcomp_strm *zstrm, const void *src,
+		unsigned int *dst_len)
+{
+	*dst_len = PAGE_SIZE << 1;
+	return crypto_comp_compress(zstrm->tfm, src, PAGE_SIZE,
+			zstrm->buffer, dst_len);
+}
+
+/*
+ * Decompress @src_len bytes at @src into the page at @dst. Fails unless
+ * exactly one page worth of data comes out.
+ */
+int zcomp_decompress(struct zcomp_strm *zstrm, const void *src,
+		unsigned int src_len, void *dst)
+{
+	unsigned int dst_len = PAGE_SIZE;
+	int ret;
+
+	ret = crypto_comp_decompress(zstrm->tfm, src, src_len, dst, &dst_len);
+	if (!ret && dst_len != PAGE_SIZE)
+		ret = -EINVAL;
+	return ret;
+}
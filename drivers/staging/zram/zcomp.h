@@ -0,0 +1,50 @@
+/*
+ * zram compression backends
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/crypto.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+/*
+ * A compression stream: a crypto transform with its private workspace and
+ * an output buffer large enough for the worst-case expansion of a page.
+ * Streams are never shared, so holders may compress in parallel.
+ */
+struct zcomp_strm {
+	struct crypto_comp *tfm;
+	void *buffer;		/* 2 pages, see zcomp_compress() */
+	struct list_head list;
+};
+
+struct zcomp {
+	char name[CRYPTO_MAX_ALG_NAME];
+	spinlock_t strm_lock;		/* protects idle_strm */
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;	/* waiters for an idle stream */
+	int nr_strms;
+};
+
+int zcomp_available(const char *name);
+struct zcomp *zcomp_create(const char *name, int nr_strms);
+void zcomp_destroy(struct zcomp *comp);
+
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp, int *waited);
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+
+int zcomp_compress(struct zcomp_strm *zstrm, const void *src,
+		unsigned int *dst_len);
+int zcomp_decompress(struct zcomp_strm *zstrm, const void *src,
+		unsigned int src_len, void *dst);
+
+#endif
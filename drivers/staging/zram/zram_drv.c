@@ -25,7 +25,6 @@
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -37,6 +36,7 @@ static struct zram *devices;
 
 /* Module params (documentation at end) */
 static unsigned int num_devices;
+static char compressor[ZRAM_MAX_COMP_NAME] = "lzo";
 
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
@@ -143,6 +143,30 @@ static void zram_ioctl_get_stats(struct zram *zram,
 #endif /* CONFIG_ZRAM_STATS */
 }
 
+static void zram_ioctl_get_comp_stats(struct zram *zram,
+			struct zram_ioctl_comp_stats *s)
+{
+	strlcpy(s->compressor, zram->compressor, sizeof(s->compressor));
+	s->nr_strms = zram->comp->nr_strms;
+
+#if defined(CONFIG_ZRAM_STATS)
+	{
+	struct zram_stats *rs = &zram->stats;
+
+	s->num_compr = zram_stat64_read(zram, &rs->num_compr);
+	s->num_decompr = zram_stat64_read(zram, &rs->num_decompr);
+	s->compr_time_ns = zram_stat64_read(zram, &rs->compr_time_ns);
+	s->decompr_time_ns = zram_stat64_read(zram, &rs->decompr_time_ns);
+	s->strm_waits = zram_stat64_read(zram, &rs->strm_waits);
+
+	if (rs->compr_size)
+		s->compr_ratio_pct = div64_u64(((u64)rs->pages_stored
+					<< PAGE_SHIFT) * 100, rs->compr_size);
+	}
+#endif /* CONFIG_ZRAM_STATS */
+}
+
+/* Called with zram->lock held */
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
@@ -214,67 +238,78 @@ static void handle_uncompressed_page(struct zram *zram,
 	flush_dcache_page(page);
 }
 
-static int zram_read(struct zram *zram, struct bio *bio)
+static int zram_read_page(struct zram *zram, struct page *page, u32 index)
 {
+	int ret, waited;
+	ktime_t start;
+	struct zcomp_strm *zstrm;
+	unsigned char *user_mem, *cmem;
 
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
+	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+		handle_zero_page(page);
+		return 0;
+	}
 
-	zram_stat64_inc(zram, &zram->stats.num_reads);
+	/* Requested page is not present in compressed area */
+	if (unlikely(!zram->table[index].page)) {
+		pr_debug("Read before write: page=%u\n", index);
+		/* Do nothing */
+		return 0;
+	}
 
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
-		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		handle_uncompressed_page(zram, page, index);
+		return 0;
+	}
 
-		page = bvec->bv_page;
+	zstrm = zcomp_strm_find(zram->comp, &waited);
+	start = zram_stat_time_start();
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			continue;
-		}
+	user_mem = kmap_atomic(page, KM_USER0);
+	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
+			zram->table[index].offset;
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			/* Do nothing */
-			continue;
-		}
+	ret = zcomp_decompress(zstrm, cmem + sizeof(struct zobj_header),
+			xv_get_object_size(cmem) - sizeof(struct zobj_header),
+			user_mem);
 
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			continue;
-		}
+	kunmap_atomic(user_mem, KM_USER0);
+	kunmap_atomic(cmem, KM_USER1);
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
+	zcomp_strm_release(zram->comp, zstrm);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	zram_stat_time_add(zram, &zram->stats.decompr_time_ns, start);
+	zram_stat64_inc(zram, &zram->stats.num_decompr);
+	if (waited)
+		zram_stat64_inc(zram, &zram->stats.strm_waits);
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret)) {
+		pr_err("Decompression failed! err=%d, page=%u\n",
+			ret, index);
+		return ret;
+	}
 
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+	flush_dcache_page(page);
+	return 0;
+}
+
+static int zram_read(struct zram *zram, struct bio *bio)
+{
+
+	int i;
+	u32 index;
+	struct bio_vec *bvec;
 
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
+	zram_stat64_inc(zram, &zram->stats.num_reads);
+
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	bio_for_each_segment(bvec, bio, i) {
+		if (zram_read_page(zram, bvec->bv_page, index)) {
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
 			goto out;
 		}
-
-		flush_dcache_page(page);
 		index++;
 	}
 
@@ -287,121 +322,136 @@ out:
 	return 0;
 }
 
-static int zram_write(struct zram *zram, struct bio *bio)
+/*
+ * Compression runs on one of the device's streams and storing the result
+ * may sleep in the allocator, so neither is done under zram->lock: that
+ * lock only covers swapping the table entry and the stats, so writers to
+ * different pages proceed in parallel.
+ */
+static int zram_write_page(struct zram *zram, struct page *page, u32 index)
 {
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
-
-	zram_stat64_inc(zram, &zram->stats.num_writes);
-
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
-
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
-		unsigned char *user_mem, *cmem, *src;
-
-		page = bvec->bv_page;
-		src = zram->compress_buffer;
+	int ret, waited;
+	u32 offset;
+	unsigned int clen;
+	ktime_t start;
+	struct zcomp_strm *zstrm;
+	struct page *page_store;
+	unsigned char *user_mem, *cmem;
 
+	user_mem = kmap_atomic(page, KM_USER0);
+	if (page_zero_filled(user_mem)) {
+		kunmap_atomic(user_mem, KM_USER0);
+		spin_lock(&zram->lock);
 		/*
 		 * System overwrites unused sectors. Free memory associated
 		 * with this sector now.
 		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
+		zram_free_page(zram, index);
+		zram_stat_inc(&zram->stats.pages_zero);
+		zram_set_flag(zram, index, ZRAM_ZERO);
+		spin_unlock(&zram->lock);
+		return 0;
+	}
+	kunmap_atomic(user_mem, KM_USER0);
 
-		mutex_lock(&zram->lock);
+	zstrm = zcomp_strm_find(zram->comp, &waited);
+	start = zram_stat_time_start();
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
-			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
-			continue;
-		}
+	user_mem = kmap_atomic(page, KM_USER0);
+	ret = zcomp_compress(zstrm, user_mem, &clen);
+	kunmap_atomic(user_mem, KM_USER0);
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+	zram_stat_time_add(zram, &zram->stats.compr_time_ns, start);
+	zram_stat64_inc(zram, &zram->stats.num_compr);
+	if (waited)
+		zram_stat64_inc(zram, &zram->stats.strm_waits);
 
-		kunmap_atomic(user_mem, KM_USER0);
+	if (unlikely(ret)) {
+		pr_err("Compression failed! err=%d\n", ret);
+		goto out;
+	}
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
-			pr_err("Compression failed! err=%d\n", ret);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
+	/*
+	 * Page is incompressible. Store it as-is (uncompressed)
+	 * since we do not want to return too many disk write
+	 * errors which has side effect of hanging the system.
+	 */
+	if (unlikely(clen > max_zpage_size)) {
+		clen = PAGE_SIZE;
+		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (unlikely(!page_store)) {
+			pr_info("Error allocating memory for "
+				"incompressible page: %u\n", index);
+			ret = -ENOMEM;
 			goto out;
 		}
+		offset = 0;
 
-		/*
-		 * Page is incompressible. Store it as-is (uncompressed)
-		 * since we do not want to return too many disk write
-		 * errors which has side effect of hanging the system.
-		 */
-		if (unlikely(clen > max_zpage_size)) {
-			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
-				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
-				zram_stat64_inc(zram,
-					&zram->stats.failed_writes);
-				goto out;
-			}
-
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
-		}
-
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
+		user_mem = kmap_atomic(page, KM_USER0);
+		cmem = kmap_atomic(page_store, KM_USER1);
+		memcpy(cmem, user_mem, PAGE_SIZE);
+		kunmap_atomic(cmem, KM_USER1);
+		kunmap_atomic(user_mem, KM_USER0);
+	} else {
+		if (xv_malloc(zram->mem_pool, clen + sizeof(struct zobj_header),
+				&page_store, &offset,
 				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
 			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
+				"page: %u, size=%u\n", index, clen);
+			ret = -ENOMEM;
 			goto out;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
+		cmem = kmap_atomic(page_store, KM_USER1) + offset;
+		memcpy(cmem + sizeof(struct zobj_header), zstrm->buffer, clen);
+		kunmap_atomic(cmem, KM_USER1);
+	}
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	zcomp_strm_release(zram->comp, zstrm);
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
-		}
-#endif
+	spin_lock(&zram->lock);
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	zram_free_page(zram, index);
 
-		memcpy(cmem, src, clen);
+	zram->table[index].page = page_store;
+	zram->table[index].offset = offset;
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+	/* Update stats */
+	if (unlikely(clen > max_zpage_size)) {
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_inc(&zram->stats.pages_expand);
+	}
+	zram->stats.compr_size += clen;
+	zram_stat_inc(&zram->stats.pages_stored);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_inc(&zram->stats.good_compress);
+	spin_unlock(&zram->lock);
 
-		/* Update stats */
-		zram->stats.compr_size += clen;
-		zram_stat_inc(&zram->stats.pages_stored);
-		if (clen <= PAGE_SIZE / 2)
-			zram_stat_inc(&zram->stats.good_compress);
+	return 0;
 
-		mutex_unlock(&zram->lock);
+out:
+	zcomp_strm_release(zram->comp, zstrm);
+	return ret;
+}
+
+static int zram_write(struct zram *zram, struct bio *bio)
+{
+	int i;
+	u32 index;
+	struct bio_vec *bvec;
+
+	zram_stat64_inc(zram, &zram->stats.num_writes);
+
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+
+	bio_for_each_segment(bvec, bio, i) {
+		if (zram_write_page(zram, bvec->bv_page, index)) {
+			zram_stat64_inc(zram, &zram->stats.failed_writes);
+			goto out;
+		}
 		index++;
 	}
 
@@ -471,11 +521,9 @@ static void reset_device(struct zram *zram)
 	zram->init_done = 0;
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	if (zram->comp)
+		zcomp_destroy(zram->comp);
+	zram->comp = NULL;
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
@@ -504,6 +552,7 @@ static void reset_device(struct zram *zram)
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
 	zram->disksize = 0;
+	strlcpy(zram->compressor, compressor, sizeof(zram->compressor));
 }
 
 static int zram_ioctl_init_device(struct zram *zram)
@@ -518,16 +567,10 @@ static int zram_ioctl_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	/* One compression stream per CPU, so writers do not serialize */
+	zram->comp = zcomp_create(zram->compressor, num_online_cpus());
+	if (!zram->comp) {
+		pr_err("Error initializing %s compressor\n", zram->compressor);
 		ret = -ENOMEM;
 		goto fail;
 	}
@@ -619,6 +662,51 @@ static int zram_ioctl(struct block_device *bdev, fmode_t mode,
 		kfree(stats);
 		break;
 	}
+	case ZRAMIO_SET_COMPRESSOR:
+	{
+		char name[ZRAM_MAX_COMP_NAME];
+
+		if (zram->init_done) {
+			ret = -EBUSY;
+			goto out;
+		}
+		if (copy_from_user(name, (void *)arg, sizeof(name))) {
+			ret = -EFAULT;
+			goto out;
+		}
+		name[sizeof(name) - 1] = '\0';
+		if (!zcomp_available(name)) {
+			pr_info("Compressor %s not available\n", name);
+			ret = -EINVAL;
+			goto out;
+		}
+		strlcpy(zram->compressor, name, sizeof(zram->compressor));
+		pr_info("Compressor set to %s\n", name);
+		break;
+	}
+
+	case ZRAMIO_GET_COMP_STATS:
+	{
+		struct zram_ioctl_comp_stats *stats;
+		if (!zram->init_done) {
+			ret = -ENOTTY;
+			goto out;
+		}
+		stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+		if (!stats) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		zram_ioctl_get_comp_stats(zram, stats);
+		if (copy_to_user((void *)arg, stats, sizeof(*stats))) {
+			kfree(stats);
+			ret = -EFAULT;
+			goto out;
+		}
+		kfree(stats);
+		break;
+	}
+
 	case ZRAMIO_INIT:
 		ret = zram_ioctl_init_device(zram);
 		break;
@@ -651,7 +739,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	spin_lock(&zram->lock);
 	zram_free_page(zram, index);
+	spin_unlock(&zram->lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -665,8 +755,9 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
+	spin_lock_init(&zram->lock);
 	spin_lock_init(&zram->stat64_lock);
+	strlcpy(zram->compressor, compressor, sizeof(zram->compressor));
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -738,6 +829,12 @@ static int __init zram_init(void)
 		goto out;
 	}
 
+	if (!zcomp_available(compressor)) {
+		pr_warning("Compressor %s not available\n", compressor);
+		ret = -EINVAL;
+		goto out;
+	}
+
 	zram_major = register_blkdev(0, "zram");
 	if (zram_major <= 0) {
 		pr_warning("Unable to get major number\n");
@@ -798,6 +895,9 @@ static void __exit zram_exit(void)
 module_param(num_devices, uint, 0);
 MODULE_PARM_DESC(num_devices, "Number of zram devices");
 
+module_param_string(compressor, compressor, sizeof(compressor), 0);
+MODULE_PARM_DESC(compressor, "Default compression algorithm (default: lzo)");
+
 module_init(zram_init);
 module_exit(zram_exit);
 
@@ -16,10 +16,11 @@
 #define _ZRAM_DRV_H_
 
 #include <linux/spinlock.h>
-#include <linux/mutex.h>
+#include <linux/ktime.h>
 
 #include "zram_ioctl.h"
 #include "xvmalloc.h"
+#include "zcomp.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -100,17 +101,21 @@ struct zram_stats {
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u64 num_compr;		/* pages compressed */
+	u64 num_decompr;	/* pages decompressed */
+	u64 compr_time_ns;	/* time spent compressing */
+	u64 decompr_time_ns;	/* time spent decompressing */
+	u64 strm_waits;		/* no. of waits for an idle stream */
 #endif
 };
 
 struct zram {
 	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zcomp *comp;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	spinlock_t lock;	/* protect table entries and 32-bit stats
+				 * against concurrent writes */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -119,6 +124,7 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	size_t disksize;	/* bytes */
+	char compressor[ZRAM_MAX_COMP_NAME];
 
 	struct zram_stats stats;
 };
@@ -137,13 +143,18 @@ static void zram_stat_dec(u32 *v)
 	*v = *v - 1;
 }
 
-static void zram_stat64_inc(struct zram *zram, u64 *v)
+static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
 {
 	spin_lock(&zram->stat64_lock);
-	*v = *v + 1;
+	*v = *v + inc;
 	spin_unlock(&zram->stat64_lock);
 }
 
+static void zram_stat64_inc(struct zram *zram, u64 *v)
+{
+	zram_stat64_add(zram, v, 1);
+}
+
 static u64 zram_stat64_read(struct zram *zram, u64 *v)
 {
 	u64 val;
@@ -154,11 +165,25 @@ static u64 zram_stat64_read(struct zram *zram, u64 *v)
 
 	return val;
 }
+
+static ktime_t zram_stat_time_start(void)
+{
+	return ktime_get();
+}
+
+/* Add the time elapsed since zram_stat_time_start() to *v */
+static void zram_stat_time_add(struct zram *zram, u64 *v, ktime_t start)
+{
+	zram_stat64_add(zram, v, ktime_to_ns(ktime_sub(ktime_get(), start)));
+}
 #else
 #define zram_stat_inc(v)
 #define zram_stat_dec(v)
+#define zram_stat64_add(r, v, i)
 #define zram_stat64_inc(r, v)
 #define zram_stat64_read(r, v)
+#define zram_stat_time_start()		ktime_set(0, 0)
+#define zram_stat_time_add(r, v, s)	do { (void)(s); } while (0)
 #endif /* CONFIG_ZRAM_STATS */
 
 #endif
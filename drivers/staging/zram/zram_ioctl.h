@@ -33,9 +33,24 @@ struct zram_ioctl_stats {
 	u64 mem_used_total;
 } __attribute__ ((packed, aligned(4)));
 
+#define ZRAM_MAX_COMP_NAME	64
+
+struct zram_ioctl_comp_stats {
+	char compressor[ZRAM_MAX_COMP_NAME];
+	u64 num_compr;		/* pages compressed */
+	u64 num_decompr;	/* pages decompressed */
+	u64 compr_time_ns;	/* total time spent compressing */
+	u64 decompr_time_ns;	/* total time spent decompressing */
+	u64 strm_waits;		/* no. of waits for an idle stream */
+	u32 nr_strms;		/* no. of compression streams */
+	u32 compr_ratio_pct;	/* orig_data_size * 100 / compr_data_size */
+} __attribute__ ((packed, aligned(4)));
+
 #define ZRAMIO_SET_DISKSIZE_KB	_IOW('z', 0, size_t)
 #define ZRAMIO_GET_STATS	_IOR('z', 1, struct zram_ioctl_stats)
 #define ZRAMIO_INIT		_IO('z', 2)
 #define ZRAMIO_RESET		_IO('z', 3)
+#define ZRAMIO_SET_COMPRESSOR	_IOW('z', 4, char[ZRAM_MAX_COMP_NAME])
+#define ZRAMIO_GET_COMP_STATS	_IOR('z', 5, struct zram_ioctl_comp_stats)
 
 #endif
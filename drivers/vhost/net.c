@@ -33,10 +33,27 @@
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_NET_WEIGHT 0x80000
 
+/* Upper bound for the max_queue_pairs module parameter. */
+#define VHOST_NET_MAX_QUEUE_PAIRS 8
+
+static int max_queue_pairs = 1;
+module_param(max_queue_pairs, int, 0444);
+MODULE_PARM_DESC(max_queue_pairs, "Number of TX/RX virtqueue pairs per "
+		 "device, each served by its own worker thread (default: 1)");
+
+static int experimental_zcopytx;
+module_param(experimental_zcopytx, int, 0444);
+MODULE_PARM_DESC(experimental_zcopytx, "Enable Experimental Zero Copy TX");
+
+/* Packets shorter than this are copied even in zero-copy mode: pinning the
+ * pages and waiting for the device costs more than the copy. */
+#define VHOST_GOODCOPY_LEN 256
+
+/* Virtqueue index within a pair: ring 2n is RX and 2n + 1 TX of pair n. */
 enum {
 	VHOST_NET_VQ_RX = 0,
 	VHOST_NET_VQ_TX = 1,
-	VHOST_NET_VQ_MAX = 2,
+	VHOST_NET_VQ_PER_PAIR = 2,
 };
 
 enum vhost_net_poll_state {
@@ -45,16 +62,39 @@ enum vhost_net_poll_state {
 	VHOST_NET_POLL_STOPPED = 2,
 };
 
-struct vhost_net {
-	struct vhost_dev dev;
-	struct vhost_virtqueue vqs[VHOST_NET_VQ_MAX];
-	struct vhost_poll poll[VHOST_NET_VQ_MAX];
+/* One TX/RX queue pair.  Both of its virtqueues and socket polls are run by
+ * the same worker thread. */
+struct vhost_net_queue {
+	struct vhost_net *net;
+	/* RX and TX virtqueues of this pair, in vhost_net.vqs */
+	struct vhost_virtqueue *vqs;
+	struct vhost_poll poll[VHOST_NET_VQ_PER_PAIR];
 	/* Tells us whether we are polling a socket for TX.
 	 * We only do this when socket buffer fills up.
 	 * Protected by tx vq lock. */
 	enum vhost_net_poll_state tx_poll_state;
 };
 
+struct vhost_net {
+	struct vhost_dev dev;
+	int nqueues;
+	struct vhost_virtqueue *vqs;
+	struct vhost_net_queue *queues;
+	struct vhost_worker *workers;
+};
+
+static bool vhost_sock_zcopy(struct socket *sock)
+{
+	return unlikely(experimental_zcopytx) &&
+		sock_flag(sock->sk, SOCK_ZEROCOPY);
+}
+
+static inline struct vhost_net_queue *vhost_net_vq_queue(struct vhost_net *n,
+						struct vhost_virtqueue *vq)
+{
+	return n->queues + (vq - n->vqs) / VHOST_NET_VQ_PER_PAIR;
+}
+
 /* Pop first len bytes from iovec. Return number of segments used. */
 static int move_iovec_hdr(struct iovec *from, struct iovec *to,
 			  size_t len, int iov_count)
@@ -92,28 +132,29 @@ static void copy_iovec_hdr(const struct iovec *from, struct iovec *to,
 }
 
 /* Caller must have TX VQ lock */
-static void tx_poll_stop(struct vhost_net *net)
+static void tx_poll_stop(struct vhost_net_queue *nq)
 {
-	if (likely(net->tx_poll_state != VHOST_NET_POLL_STARTED))
+	if (likely(nq->tx_poll_state != VHOST_NET_POLL_STARTED))
 		return;
-	vhost_poll_stop(net->poll + VHOST_NET_VQ_TX);
-	net->tx_poll_state = VHOST_NET_POLL_STOPPED;
+	vhost_poll_stop(nq->poll + VHOST_NET_VQ_TX);
+	nq->tx_poll_state = VHOST_NET_POLL_STOPPED;
 }
 
 /* Caller must have TX VQ lock */
-static void tx_poll_start(struct vhost_net *net, struct socket *sock)
+static void tx_poll_start(struct vhost_net_queue *nq, struct socket *sock)
 {
-	if (unlikely(net->tx_poll_state != VHOST_NET_POLL_STOPPED))
+	if (unlikely(nq->tx_poll_state != VHOST_NET_POLL_STOPPED))
 		return;
-	vhost_poll_start(net->poll + VHOST_NET_VQ_TX, sock->file);
-	net->tx_poll_state = VHOST_NET_POLL_STARTED;
+	vhost_poll_start(nq->poll + VHOST_NET_VQ_TX, sock->file);
+	nq->tx_poll_state = VHOST_NET_POLL_STARTED;
 }
 
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
-static void handle_tx(struct vhost_net *net)
+static void handle_tx(struct vhost_net_queue *nq)
 {
-	struct vhost_virtqueue *vq = &net->dev.vqs[VHOST_NET_VQ_TX];
+	struct vhost_net *net = nq->net;
+	struct vhost_virtqueue *vq = nq->vqs + VHOST_NET_VQ_TX;
 	unsigned out, in, s;
 	int head;
 	struct msghdr msg = {
@@ -127,6 +168,8 @@ static void handle_tx(struct vhost_net *net)
 	size_t len, total_len = 0;
 	int err, wmem;
 	size_t hdr_size;
+	struct vhost_ubuf_ref *uninitialized_var(ubufs);
+	bool zcopy;
 	struct socket *sock = rcu_dereference(vq->private_data);
 	if (!sock)
 		return;
@@ -134,7 +177,7 @@ static void handle_tx(struct vhost_net *net)
 	wmem = atomic_read(&sock->sk->sk_wmem_alloc);
 	if (wmem >= sock->sk->sk_sndbuf) {
 		mutex_lock(&vq->mutex);
-		tx_poll_start(net, sock);
+		tx_poll_start(nq, sock);
 		mutex_unlock(&vq->mutex);
 		return;
 	}
@@ -144,10 +187,22 @@ static void handle_tx(struct vhost_net *net)
 	vhost_disable_notify(vq);
 
 	if (wmem < sock->sk->sk_sndbuf / 2)
-		tx_poll_stop(net);
+		tx_poll_stop(nq);
 	hdr_size = vq->vhost_hlen;
+	zcopy = vq->ubufs;
 
 	for (;;) {
+		if (zcopy) {
+			/* Release DMAs done buffers first */
+			vhost_zerocopy_signal_used(vq);
+			/* Too many buffers lent to the lower device: the
+			 * completion callback will requeue us. */
+			if (unlikely((vq->upend_idx - vq->done_idx +
+				      VHOST_ZCOPY_RING) % VHOST_ZCOPY_RING >=
+				     VHOST_MAX_PEND))
+				break;
+		}
+
 		head = vhost_get_vq_desc(&net->dev, vq, vq->iov,
 					 ARRAY_SIZE(vq->iov),
 					 &out, &in,
@@ -159,7 +214,7 @@ static void handle_tx(struct vhost_net *net)
 		if (head == vq->num) {
 			wmem = atomic_read(&sock->sk->sk_wmem_alloc);
 			if (wmem >= sock->sk->sk_sndbuf * 3 / 4) {
-				tx_poll_start(net, sock);
+				tx_poll_start(nq, sock);
 				set_bit(SOCK_ASYNC_NOSPACE, &sock->flags);
 				break;
 			}
@@ -185,17 +240,52 @@ static void handle_tx(struct vhost_net *net)
 			       iov_length(vq->hdr, s), hdr_size);
 			break;
 		}
+		if (zcopy) {
+			ubufs = NULL;
+			vq->zc_heads[vq->upend_idx].id = head;
+			if (len < VHOST_GOODCOPY_LEN) {
+				/* copy don't need to wait for DMA done */
+				vq->zc_heads[vq->upend_idx].len =
+							VHOST_DMA_DONE_LEN;
+				msg.msg_control = NULL;
+				msg.msg_controllen = 0;
+			} else {
+				struct ubuf_info *ubuf;
+				ubuf = vq->ubuf_info + vq->upend_idx;
+
+				vq->zc_heads[vq->upend_idx].len =
+							VHOST_DMA_IN_PROGRESS;
+				ubuf->callback = vhost_zerocopy_callback;
+				ubuf->arg = vq->ubufs;
+				ubuf->desc = vq->upend_idx;
+				msg.msg_control = ubuf;
+				msg.msg_controllen = sizeof(ubuf);
+				ubufs = vq->ubufs;
+				kref_get(&ubufs->kref);
+			}
+			vq->upend_idx = (vq->upend_idx + 1) % VHOST_ZCOPY_RING;
+		}
 		/* TODO: Check specific error and bomb out unless ENOBUFS? */
 		err = sock->ops->sendmsg(NULL, sock, &msg, len);
 		if (unlikely(err < 0)) {
+			if (zcopy) {
+				if (ubufs)
+					vhost_ubuf_put(ubufs);
+				vq->upend_idx = (vq->upend_idx +
+						 VHOST_ZCOPY_RING - 1) %
+						VHOST_ZCOPY_RING;
+			}
 			vhost_discard_vq_desc(vq, 1);
-			tx_poll_start(net, sock);
+			tx_poll_start(nq, sock);
 			break;
 		}
 		if (err != len)
 			pr_debug("Truncated TX packet: "
 				 " len %d != %zd\n", err, len);
-		vhost_add_used_and_signal(&net->dev, vq, head, 0);
+		if (!zcopy)
+			vhost_add_used_and_signal(&net->dev, vq, head, 0);
+		else
+			vhost_zerocopy_signal_used(vq);
 		total_len += len;
 		if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
 			vhost_poll_queue(&vq->poll);
@@ -282,9 +372,10 @@ err:
 
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
-static void handle_rx_big(struct vhost_net *net)
+static void handle_rx_big(struct vhost_net_queue *nq)
 {
-	struct vhost_virtqueue *vq = &net->dev.vqs[VHOST_NET_VQ_RX];
+	struct vhost_net *net = nq->net;
+	struct vhost_virtqueue *vq = nq->vqs + VHOST_NET_VQ_RX;
 	unsigned out, in, log, s;
 	int head;
 	struct vhost_log *vq_log;
@@ -393,9 +484,10 @@ static void handle_rx_big(struct vhost_net *net)
 
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
-static void handle_rx_mergeable(struct vhost_net *net)
+static void handle_rx_mergeable(struct vhost_net_queue *nq)
 {
-	struct vhost_virtqueue *vq = &net->dev.vqs[VHOST_NET_VQ_RX];
+	struct vhost_net *net = nq->net;
+	struct vhost_virtqueue *vq = nq->vqs + VHOST_NET_VQ_RX;
 	unsigned uninitialized_var(in), log;
 	struct vhost_log *vq_log;
 	struct msghdr msg = {
@@ -500,12 +592,12 @@ static void handle_rx_mergeable(struct vhost_net *net)
 	unuse_mm(net->dev.mm);
 }
 
-static void handle_rx(struct vhost_net *net)
+static void handle_rx(struct vhost_net_queue *nq)
 {
-	if (vhost_has_feature(&net->dev, VIRTIO_NET_F_MRG_RXBUF))
-		handle_rx_mergeable(net);
+	if (vhost_has_feature(&nq->net->dev, VIRTIO_NET_F_MRG_RXBUF))
+		handle_rx_mergeable(nq);
 	else
-		handle_rx_big(net);
+		handle_rx_big(nq);
 }
 
 static void handle_tx_kick(struct vhost_work *work)
@@ -514,7 +606,7 @@ static void handle_tx_kick(struct vhost_work *work)
 						  poll.work);
 	struct vhost_net *net = container_of(vq->dev, struct vhost_net, dev);
 
-	handle_tx(net);
+	handle_tx(vhost_net_vq_queue(net, vq));
 }
 
 static void handle_rx_kick(struct vhost_work *work)
@@ -523,44 +615,93 @@ static void handle_rx_kick(struct vhost_work *work)
 						  poll.work);
 	struct vhost_net *net = container_of(vq->dev, struct vhost_net, dev);
 
-	handle_rx(net);
+	handle_rx(vhost_net_vq_queue(net, vq));
 }
 
 static void handle_tx_net(struct vhost_work *work)
 {
-	struct vhost_net *net = container_of(work, struct vhost_net,
-					     poll[VHOST_NET_VQ_TX].work);
-	handle_tx(net);
+	struct vhost_net_queue *nq = container_of(work, struct vhost_net_queue,
+						  poll[VHOST_NET_VQ_TX].work);
+	handle_tx(nq);
 }
 
 static void handle_rx_net(struct vhost_work *work)
 {
-	struct vhost_net *net = container_of(work, struct vhost_net,
-					     poll[VHOST_NET_VQ_RX].work);
-	handle_rx(net);
+	struct vhost_net_queue *nq = container_of(work, struct vhost_net_queue,
+						  poll[VHOST_NET_VQ_RX].work);
+	handle_rx(nq);
+}
+
+static void vhost_net_free(struct vhost_net *n)
+{
+	int i;
+
+	for (i = 0; n->vqs && i < n->nqueues * VHOST_NET_VQ_PER_PAIR; ++i) {
+		kfree(n->vqs[i].zc_heads);
+		kfree(n->vqs[i].ubuf_info);
+	}
+	kfree(n->workers);
+	kfree(n->queues);
+	kfree(n->vqs);
+	kfree(n);
 }
 
 static int vhost_net_open(struct inode *inode, struct file *f)
 {
-	struct vhost_net *n = kmalloc(sizeof *n, GFP_KERNEL);
+	struct vhost_net *n = kzalloc(sizeof *n, GFP_KERNEL);
+	struct vhost_net_queue *nq;
 	struct vhost_dev *dev;
-	int r;
+	int i, r;
 
 	if (!n)
 		return -ENOMEM;
 
+	n->nqueues = clamp(max_queue_pairs, 1, VHOST_NET_MAX_QUEUE_PAIRS);
+	n->vqs = kcalloc(n->nqueues * VHOST_NET_VQ_PER_PAIR, sizeof *n->vqs,
+			 GFP_KERNEL);
+	n->queues = kcalloc(n->nqueues, sizeof *n->queues, GFP_KERNEL);
+	n->workers = kcalloc(n->nqueues, sizeof *n->workers, GFP_KERNEL);
+	if (!n->vqs || !n->queues || !n->workers) {
+		vhost_net_free(n);
+		return -ENOMEM;
+	}
+
 	dev = &n->dev;
-	n->vqs[VHOST_NET_VQ_TX].handle_kick = handle_tx_kick;
-	n->vqs[VHOST_NET_VQ_RX].handle_kick = handle_rx_kick;
-	r = vhost_dev_init(dev, n->vqs, VHOST_NET_VQ_MAX);
+	for (i = 0; i < n->nqueues; ++i) {
+		nq = n->queues + i;
+		nq->net = n;
+		nq->vqs = n->vqs + i * VHOST_NET_VQ_PER_PAIR;
+		nq->vqs[VHOST_NET_VQ_TX].handle_kick = handle_tx_kick;
+		nq->vqs[VHOST_NET_VQ_RX].handle_kick = handle_rx_kick;
+		if (!experimental_zcopytx)
+			continue;
+		nq->vqs[VHOST_NET_VQ_TX].zc_heads =
+			kcalloc(VHOST_ZCOPY_RING, sizeof(struct vring_used_elem),
+				GFP_KERNEL);
+		nq->vqs[VHOST_NET_VQ_TX].ubuf_info =
+			kcalloc(VHOST_ZCOPY_RING, sizeof(struct ubuf_info),
+				GFP_KERNEL);
+		if (!nq->vqs[VHOST_NET_VQ_TX].zc_heads ||
+		    !nq->vqs[VHOST_NET_VQ_TX].ubuf_info) {
+			vhost_net_free(n);
+			return -ENOMEM;
+		}
+	}
+	r = vhost_dev_init(dev, n->vqs, n->nqueues * VHOST_NET_VQ_PER_PAIR,
+			   n->workers, n->nqueues);
 	if (r < 0) {
-		kfree(n);
+		vhost_net_free(n);
 		return r;
 	}
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev);
-	n->tx_poll_state = VHOST_NET_POLL_DISABLED;
+	for (i = 0; i < n->nqueues; ++i) {
+		nq = n->queues + i;
+		vhost_poll_init(nq->poll + VHOST_NET_VQ_TX, handle_tx_net,
+				POLLOUT, nq->vqs[VHOST_NET_VQ_TX].worker);
+		vhost_poll_init(nq->poll + VHOST_NET_VQ_RX, handle_rx_net,
+				POLLIN, nq->vqs[VHOST_NET_VQ_RX].worker);
+		nq->tx_poll_state = VHOST_NET_POLL_DISABLED;
+	}
 
 	f->private_data = n;
 
@@ -570,26 +711,29 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 static void vhost_net_disable_vq(struct vhost_net *n,
 				 struct vhost_virtqueue *vq)
 {
+	struct vhost_net_queue *nq = vhost_net_vq_queue(n, vq);
+
 	if (!vq->private_data)
 		return;
-	if (vq == n->vqs + VHOST_NET_VQ_TX) {
-		tx_poll_stop(n);
-		n->tx_poll_state = VHOST_NET_POLL_DISABLED;
+	if (vq == nq->vqs + VHOST_NET_VQ_TX) {
+		tx_poll_stop(nq);
+		nq->tx_poll_state = VHOST_NET_POLL_DISABLED;
 	} else
-		vhost_poll_stop(n->poll + VHOST_NET_VQ_RX);
+		vhost_poll_stop(nq->poll + VHOST_NET_VQ_RX);
 }
 
 static void vhost_net_enable_vq(struct vhost_net *n,
 				struct vhost_virtqueue *vq)
 {
+	struct vhost_net_queue *nq = vhost_net_vq_queue(n, vq);
 	struct socket *sock = vq->private_data;
 	if (!sock)
 		return;
-	if (vq == n->vqs + VHOST_NET_VQ_TX) {
-		n->tx_poll_state = VHOST_NET_POLL_STOPPED;
-		tx_poll_start(n, sock);
+	if (vq == nq->vqs + VHOST_NET_VQ_TX) {
+		nq->tx_poll_state = VHOST_NET_POLL_STOPPED;
+		tx_poll_start(nq, sock);
 	} else
-		vhost_poll_start(n->poll + VHOST_NET_VQ_RX, sock->file);
+		vhost_poll_start(nq->poll + VHOST_NET_VQ_RX, sock->file);
 }
 
 static struct socket *vhost_net_stop_vq(struct vhost_net *n,
@@ -605,42 +749,53 @@ static struct socket *vhost_net_stop_vq(struct vhost_net *n,
 	return sock;
 }
 
-static void vhost_net_stop(struct vhost_net *n, struct socket **tx_sock,
-			   struct socket **rx_sock)
+/* socks must have room for a socket per virtqueue. */
+static void vhost_net_stop(struct vhost_net *n, struct socket **socks)
+{
+	int i;
+
+	for (i = 0; i < n->dev.nvqs; ++i)
+		socks[i] = vhost_net_stop_vq(n, n->vqs + i);
+}
+
+static void vhost_net_put_socks(struct vhost_net *n, struct socket **socks)
 {
-	*tx_sock = vhost_net_stop_vq(n, n->vqs + VHOST_NET_VQ_TX);
-	*rx_sock = vhost_net_stop_vq(n, n->vqs + VHOST_NET_VQ_RX);
+	int i;
+
+	for (i = 0; i < n->dev.nvqs; ++i)
+		if (socks[i])
+			fput(socks[i]->file);
 }
 
 static void vhost_net_flush_vq(struct vhost_net *n, int index)
 {
-	vhost_poll_flush(n->poll + index);
+	struct vhost_net_queue *nq = n->queues + index / VHOST_NET_VQ_PER_PAIR;
+
+	vhost_poll_flush(nq->poll + index % VHOST_NET_VQ_PER_PAIR);
 	vhost_poll_flush(&n->dev.vqs[index].poll);
 }
 
 static void vhost_net_flush(struct vhost_net *n)
 {
-	vhost_net_flush_vq(n, VHOST_NET_VQ_TX);
-	vhost_net_flush_vq(n, VHOST_NET_VQ_RX);
+	int i;
+
+	for (i = 0; i < n->dev.nvqs; ++i)
+		vhost_net_flush_vq(n, i);
 }
 
 static int vhost_net_release(struct inode *inode, struct file *f)
 {
 	struct vhost_net *n = f->private_data;
-	struct socket *tx_sock;
-	struct socket *rx_sock;
+	struct socket *socks[VHOST_NET_MAX_QUEUE_PAIRS * VHOST_NET_VQ_PER_PAIR];
 
-	vhost_net_stop(n, &tx_sock, &rx_sock);
+	vhost_net_stop(n, socks);
 	vhost_net_flush(n);
 	vhost_dev_cleanup(&n->dev);
-	if (tx_sock)
-		fput(tx_sock->file);
-	if (rx_sock)
-		fput(rx_sock->file);
+	vhost_net_put_socks(n, socks);
 	/* We do an extra flush before freeing memory,
 	 * since jobs can re-queue themselves. */
 	vhost_net_flush(n);
-	kfree(n);
+	vhost_net_free(n);
 	return 0;
 }
 
@@ -710,6 +865,7 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 {
 	struct socket *sock, *oldsock;
 	struct vhost_virtqueue *vq;
+	struct vhost_ubuf_ref *ubufs, *oldubufs = NULL;
 	int r;
 
 	mutex_lock(&n->dev.mutex);
@@ -717,7 +873,7 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 	if (r)
 		goto err;
 
-	if (index >= VHOST_NET_VQ_MAX) {
+	if (index >= n->dev.nvqs) {
 		r = -ENOBUFS;
 		goto err;
 	}
@@ -738,6 +894,14 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 	/* start polling new socket */
 	oldsock = vq->private_data;
 	if (sock != oldsock) {
+		ubufs = vhost_ubuf_alloc(vq, sock && vq->zc_heads &&
+					 vhost_sock_zcopy(sock));
+		if (IS_ERR(ubufs)) {
+			r = PTR_ERR(ubufs);
+			goto err_ubufs;
+		}
+		oldubufs = vq->ubufs;
+		vq->ubufs = ubufs;
                 vhost_net_disable_vq(n, vq);
                 rcu_assign_pointer(vq->private_data, sock);
                 vhost_net_enable_vq(n, vq);
@@ -745,6 +909,14 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 
 	mutex_unlock(&vq->mutex);
 
+	if (oldubufs) {
+		/* Wait for the old socket's skbs to leave the device. */
+		vhost_ubuf_put_and_wait(oldubufs);
+		mutex_lock(&vq->mutex);
+		vhost_zerocopy_signal_used(vq);
+		mutex_unlock(&vq->mutex);
+	}
+
 	if (oldsock) {
 		vhost_net_flush_vq(n, index);
 		fput(oldsock->file);
@@ -753,6 +925,9 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 	mutex_unlock(&n->dev.mutex);
 	return 0;
 
+err_ubufs:
+	if (sock)
+		fput(sock->file);
 err_vq:
 	mutex_unlock(&vq->mutex);
 err:
@@ -762,22 +937,19 @@ err:
 
 static long vhost_net_reset_owner(struct vhost_net *n)
 {
-	struct socket *tx_sock = NULL;
-	struct socket *rx_sock = NULL;
+	struct socket *socks[VHOST_NET_MAX_QUEUE_PAIRS * VHOST_NET_VQ_PER_PAIR];
 	long err;
 	mutex_lock(&n->dev.mutex);
 	err = vhost_dev_check_owner(&n->dev);
-	if (err)
-		goto done;
-	vhost_net_stop(n, &tx_sock, &rx_sock);
+	if (err) {
+		mutex_unlock(&n->dev.mutex);
+		return err;
+	}
+	vhost_net_stop(n, socks);
 	vhost_net_flush(n);
 	err = vhost_dev_reset_owner(&n->dev);
-done:
 	mutex_unlock(&n->dev.mutex);
-	if (tx_sock)
-		fput(tx_sock->file);
-	if (rx_sock)
-		fput(rx_sock->file);
+	vhost_net_put_socks(n, socks);
 	return err;
 }
 
@@ -806,7 +978,7 @@ static int vhost_net_set_features(struct vhost_net *n, u64 features)
 	}
 	n->dev.acked_features = features;
 	smp_wmb();
-	for (i = 0; i < VHOST_NET_VQ_MAX; ++i) {
+	for (i = 0; i < n->dev.nvqs; ++i) {
 		mutex_lock(&n->vqs[i].mutex);
 		n->vqs[i].vhost_hlen = vhost_hlen;
 		n->vqs[i].sock_hlen = sock_hlen;
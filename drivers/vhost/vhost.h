@@ -11,6 +11,8 @@
 #include <linux/uio.h>
 #include <linux/virtio_config.h>
 #include <linux/virtio_ring.h>
+#include <linux/kref.h>
+#include <linux/completion.h>
 #include <asm/atomic.h>
 
 struct vhost_device;
@@ -32,6 +34,15 @@ struct vhost_work {
 	unsigned		  done_seq;
 };
 
+/* A kthread together with the list of work queued to it.  A device has one
+ * worker per group of virtqueues, so that independent queues can be served
+ * (and pinned) on separate CPUs. */
+struct vhost_worker {
+	spinlock_t		  work_lock;
+	struct list_head	  work_list;
+	struct task_struct	 *task;
+};
+
 /* Poll a file (eventfd or socket) */
 /* Note: there's nothing vhost specific about this structure. */
 struct vhost_poll {
@@ -40,11 +51,11 @@ struct vhost_poll {
 	wait_queue_t              wait;
 	struct vhost_work	  work;
 	unsigned long		  mask;
-	struct vhost_dev	 *dev;
+	struct vhost_worker	 *worker;
 };
 
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev);
+		     unsigned long mask, struct vhost_worker *worker);
 void vhost_poll_start(struct vhost_poll *poll, struct file *file);
 void vhost_poll_stop(struct vhost_poll *poll);
 void vhost_poll_flush(struct vhost_poll *poll);
@@ -55,9 +66,31 @@ struct vhost_log {
 	u64 len;
 };
 
+/* Zero-copy transmit: slots of the pending ring, and the used length each
+ * holds until the lower device is done with the buffers. */
+enum {
+	VHOST_ZCOPY_RING = 256,
+	/* Most descriptors lent to the lower device at any time. */
+	VHOST_MAX_PEND = 128,
+	VHOST_DMA_DONE_LEN = 1,
+	VHOST_DMA_IN_PROGRESS = 0,
+};
+
+struct vhost_ubuf_ref {
+	struct kref kref;
+	struct completion done;
+	struct vhost_virtqueue *vq;
+};
+
+struct vhost_ubuf_ref *vhost_ubuf_alloc(struct vhost_virtqueue *, bool zcopy);
+void vhost_ubuf_put(struct vhost_ubuf_ref *);
+void vhost_ubuf_put_and_wait(struct vhost_ubuf_ref *);
+
 /* The virtqueue structure describes a queue attached to a device. */
 struct vhost_virtqueue {
 	struct vhost_dev *dev;
+	/* The worker that runs this queue's kick and backend handlers. */
+	struct vhost_worker *worker;
 
 	/* The actual ring of buffers. */
 	struct mutex mutex;
@@ -110,6 +143,18 @@ struct vhost_virtqueue {
 	/* Log write descriptors */
 	void __user *log_base;
 	struct vhost_log log[VHOST_NET_MAX_SG];
+	/* Zero-copy transmit.  zc_heads is a ring of the descriptors handed
+	 * to the lower device, in submission order: upend_idx is the next
+	 * free slot, done_idx the oldest one not yet returned to the guest.
+	 * ubuf_info is indexed like zc_heads.  Both arrays are allocated
+	 * by the device and are NULL when it does not do zero-copy. */
+	int upend_idx;
+	int done_idx;
+	struct vring_used_elem *zc_heads;
+	struct ubuf_info *ubuf_info;
+	/* Reference counting for outstanding ubufs.
+	 * Protected by vq mutex. Writers must also take device mutex. */
+	struct vhost_ubuf_ref *ubufs;
 };
 
 struct vhost_dev {
@@ -124,12 +169,12 @@ struct vhost_dev {
 	int nvqs;
 	struct file *log_file;
 	struct eventfd_ctx *log_ctx;
-	spinlock_t work_lock;
-	struct list_head work_list;
-	struct task_struct *worker;
+	struct vhost_worker *workers;
+	int nworkers;
 };
 
-long vhost_dev_init(struct vhost_dev *, struct vhost_virtqueue *vqs, int nvqs);
+long vhost_dev_init(struct vhost_dev *, struct vhost_virtqueue *vqs, int nvqs,
+		    struct vhost_worker *workers, int nworkers);
 long vhost_dev_check_owner(struct vhost_dev *);
 long vhost_dev_reset_owner(struct vhost_dev *);
 void vhost_dev_cleanup(struct vhost_dev *);
@@ -156,6 +201,8 @@ bool vhost_enable_notify(struct vhost_virtqueue *);
 
 int vhost_log_write(struct vhost_virtqueue *vq, struct vhost_log *log,
 		    unsigned int log_num, u64 len);
+void vhost_zerocopy_callback(struct ubuf_info *);
+int vhost_zerocopy_signal_used(struct vhost_virtqueue *vq);
 
 #define vq_err(vq, fmt, ...) do {                                  \
 		pr_debug(pr_fmt(fmt), ##__VA_ARGS__);       \
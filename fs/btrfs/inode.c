@@ -6829,6 +6829,10 @@ static long btrfs_fallocate(struct inode *inode, int mode,
 	struct extent_map *em;
 	int ret;
 
+	/* We only support the FALLOC_FL_KEEP_SIZE mode */
+	if (mode & ~FALLOC_FL_KEEP_SIZE)
+		return -EOPNOTSUPP;
+
 	alloc_start = offset & ~mask;
 	alloc_end =  (offset + len + mask) & ~mask;
 
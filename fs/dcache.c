@@ -33,6 +33,7 @@
 #include <linux/bootmem.h>
 #include <linux/fs_struct.h>
 #include <linux/hardirq.h>
+#include <linux/sysctl.h>
 #include "internal.h"
 
 int sysctl_vfs_cache_pressure __read_mostly = 100;
@@ -60,7 +61,32 @@ static struct kmem_cache *dentry_cache __read_mostly;
 
 static unsigned int d_hash_mask __read_mostly;
 static unsigned int d_hash_shift __read_mostly;
-static struct hlist_head *dentry_hashtable __read_mostly;
+static struct hlist_bl_head *dentry_hashtable __read_mostly;
+
+/*
+ * Each hash chain is protected by the bit lock in its head (see
+ * hlist_bl_lock), lookups walk the chains under RCU.  Disconnected
+ * roots from d_obtain_alias live on their superblock's s_anon chain
+ * instead.
+ */
+static inline struct hlist_bl_head *d_hash(struct dentry *parent,
+					unsigned long hash)
+{
+	hash += ((unsigned long) parent ^ GOLDEN_RATIO_PRIME) / L1_CACHE_BYTES;
+	hash = hash ^ ((hash ^ GOLDEN_RATIO_PRIME) >> D_HASHBITS);
+	return dentry_hashtable + (hash & D_HASHMASK);
+}
+
+/*
+ * Chain a hashed dentry is on.  The caller must keep d_parent and
+ * d_name stable, which holding d_lock does.
+ */
+static inline struct hlist_bl_head *d_hash_chain(struct dentry *dentry)
+{
+	if (IS_ROOT(dentry))
+		return &dentry->d_sb->s_anon;
+	return d_hash(dentry->d_parent, dentry->d_name.hash);
+}
 
 /* Statistics gathering. */
 struct dentry_stat_t dentry_stat = {
@@ -84,18 +110,39 @@ static void d_callback(struct rcu_head *head)
 /*
  * no dcache_lock, please.  The caller must decrement dentry_stat.nr_dentry
  * inside dcache_lock.
+ *
+ * Even a dentry that was never hashed may be reached by rcu-walk through
+ * a mount root or a task's root and cwd, so always free it after a grace
+ * period.
  */
 static void d_free(struct dentry *dentry)
 {
 	if (dentry->d_op && dentry->d_op->d_release)
 		dentry->d_op->d_release(dentry);
-	/* if dentry was never inserted into hash, immediate free is OK */
-	if (hlist_unhashed(&dentry->d_hash))
-		__d_free(dentry);
-	else
-		call_rcu(&dentry->d_u.d_rcu, d_callback);
+	call_rcu(&dentry->d_u.d_rcu, d_callback);
 }
 
+/**
+ * __d_drop - drop a dentry from its hash chain
+ * @dentry: dentry to drop
+ *
+ * See d_drop.  The caller must hold dentry->d_lock.
+ */
+void __d_drop(struct dentry *dentry)
+{
+	if (!(dentry->d_flags & DCACHE_UNHASHED)) {
+		struct hlist_bl_head *b = d_hash_chain(dentry);
+
+		hlist_bl_lock(b);
+		write_seqcount_begin(&dentry->d_seq);
+		dentry->d_flags |= DCACHE_UNHASHED;
+		hlist_bl_del_rcu(&dentry->d_hash);
+		write_seqcount_end(&dentry->d_seq);
+		hlist_bl_unlock(b);
+	}
+}
+EXPORT_SYMBOL(__d_drop);
+
 /*
  * Release the dentry's inode, using the filesystem
  * d_iput() operation if defined.
@@ -106,7 +153,9 @@ static void dentry_iput(struct dentry * dentry)
 {
 	struct inode *inode = dentry->d_inode;
 	if (inode) {
+		write_seqcount_begin(&dentry->d_seq);
 		dentry->d_inode = NULL;
+		write_seqcount_end(&dentry->d_seq);
 		list_del_init(&dentry->d_alias);
 		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
@@ -123,37 +172,86 @@ static void dentry_iput(struct dentry * dentry)
 }
 
 /*
- * dentry_lru_(add|add_tail|del|del_init) must be called with dcache_lock held.
+ * The dentry LRU is per superblock and protected by sb->s_dentry_lru_lock,
+ * which nests inside dcache_lock and dentry->d_lock.  Unused dentries are
+ * added to it without dcache_lock (see dput), so anything walking
+ * sb->s_dentry_lru must hold the LRU lock.  Removal still requires
+ * dcache_lock, which keeps the private lists built by __shrink_dcache_sb
+ * stable.
  */
+static DEFINE_PER_CPU(int, nr_dentry_unused);
+
+static int get_nr_dentry_unused(void)
+{
+	int i;
+	int sum = 0;
+
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_unused, i);
+	return sum < 0 ? 0 : sum;
+}
+
+/*
+ * Handle nr_dentry sysctl
+ */
+#ifdef CONFIG_SYSCTL
+int proc_nr_dentry(ctl_table *table, int write,
+		   void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	dentry_stat.nr_unused = get_nr_dentry_unused();
+	return proc_dointvec(table, write, buffer, lenp, ppos);
+}
+#endif
+
 static void dentry_lru_add(struct dentry *dentry)
 {
-	list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-	dentry->d_sb->s_nr_dentry_unused++;
-	dentry_stat.nr_unused++;
+	struct super_block *sb = dentry->d_sb;
+
+	spin_lock(&sb->s_dentry_lru_lock);
+	if (list_empty(&dentry->d_lru)) {
+		list_add(&dentry->d_lru, &sb->s_dentry_lru);
+		sb->s_nr_dentry_unused++;
+		this_cpu_inc(nr_dentry_unused);
+	}
+	spin_unlock(&sb->s_dentry_lru_lock);
 }
 
 static void dentry_lru_add_tail(struct dentry *dentry)
 {
-	list_add_tail(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-	dentry->d_sb->s_nr_dentry_unused++;
-	dentry_stat.nr_unused++;
+	struct super_block *sb = dentry->d_sb;
+
+	spin_lock(&sb->s_dentry_lru_lock);
+	if (list_empty(&dentry->d_lru)) {
+		list_add_tail(&dentry->d_lru, &sb->s_dentry_lru);
+		sb->s_nr_dentry_unused++;
+		this_cpu_inc(nr_dentry_unused);
+	}
+	spin_unlock(&sb->s_dentry_lru_lock);
 }
 
 static void dentry_lru_del(struct dentry *dentry)
 {
+	struct super_block *sb = dentry->d_sb;
+
 	if (!list_empty(&dentry->d_lru)) {
+		spin_lock(&sb->s_dentry_lru_lock);
 		list_del(&dentry->d_lru);
-		dentry->d_sb->s_nr_dentry_unused--;
-		dentry_stat.nr_unused--;
+		sb->s_nr_dentry_unused--;
+		this_cpu_dec(nr_dentry_unused);
+		spin_unlock(&sb->s_dentry_lru_lock);
 	}
 }
 
 static void dentry_lru_del_init(struct dentry *dentry)
 {
+	struct super_block *sb = dentry->d_sb;
+
 	if (likely(!list_empty(&dentry->d_lru))) {
+		spin_lock(&sb->s_dentry_lru_lock);
 		list_del_init(&dentry->d_lru);
-		dentry->d_sb->s_nr_dentry_unused--;
-		dentry_stat.nr_unused--;
+		sb->s_nr_dentry_unused--;
+		this_cpu_dec(nr_dentry_unused);
+		spin_unlock(&sb->s_dentry_lru_lock);
 	}
 }
 
@@ -209,7 +307,8 @@ static struct dentry *d_kill(struct dentry *dentry)
  * releasing its resources. If the parent dentries were scheduled for release
  * they too may now get deleted.
  *
- * no dcache lock, please.
+ * no dcache lock, please.  The common case of parking an unused, hashed
+ * dentry on the LRU does not take dcache_lock either.
  */
 
 void dput(struct dentry *dentry)
@@ -220,6 +319,28 @@ void dput(struct dentry *dentry)
 repeat:
 	if (atomic_read(&dentry->d_count) == 1)
 		might_sleep();
+	if (atomic_add_unless(&dentry->d_count, -1, 1))
+		return;
+
+	/*
+	 * Dropping the last reference to a hashed dentry that has no
+	 * ->d_delete() only parks it on the LRU.  That needs d_lock (which
+	 * keeps it from being unhashed under us) and the superblock's LRU
+	 * lock, but not dcache_lock.
+	 */
+	spin_lock(&dentry->d_lock);
+	if (!d_unhashed(dentry) &&
+	    !(dentry->d_op && dentry->d_op->d_delete)) {
+		if (atomic_dec_and_test(&dentry->d_count) &&
+		    list_empty(&dentry->d_lru)) {
+			dentry->d_flags |= DCACHE_REFERENCED;
+			dentry_lru_add(dentry);
+		}
+		spin_unlock(&dentry->d_lock);
+		return;
+	}
+	spin_unlock(&dentry->d_lock);
+
 	if (!atomic_dec_and_lock(&dentry->d_count, &dcache_lock))
 		return;
 
@@ -470,6 +591,7 @@ static void __shrink_dcache_sb(struct super_block *sb, int *count, int flags)
 		/* called from prune_dcache() and shrink_dcache_parent() */
 		cnt = *count;
 restart:
+	spin_lock(&sb->s_dentry_lru_lock);
 	if (count == NULL)
 		list_splice_init(&sb->s_dentry_lru, &tmp);
 	else {
@@ -478,7 +600,16 @@ restart:
 					struct dentry, d_lru);
 			BUG_ON(dentry->d_sb != sb);
 
-			spin_lock(&dentry->d_lock);
+			/*
+			 * d_lock nests outside the LRU lock, so back off and
+			 * retry if someone is busy with this dentry.
+			 */
+			if (!spin_trylock(&dentry->d_lock)) {
+				spin_unlock(&sb->s_dentry_lru_lock);
+				cpu_relax();
+				spin_lock(&sb->s_dentry_lru_lock);
+				continue;
+			}
 			/*
 			 * If we are honouring the DCACHE_REFERENCED flag and
 			 * the dentry has this flag set, don't free it. Clear
@@ -496,9 +627,12 @@ restart:
 				if (!cnt)
 					break;
 			}
-			cond_resched_lock(&dcache_lock);
 		}
 	}
+	if (!list_empty(&referenced))
+		list_splice_init(&referenced, &sb->s_dentry_lru);
+	spin_unlock(&sb->s_dentry_lru_lock);
+
 	while (!list_empty(&tmp)) {
 		dentry = list_entry(tmp.prev, struct dentry, d_lru);
 		dentry_lru_del_init(dentry);
@@ -520,8 +654,6 @@ restart:
 		goto restart;
 	if (count != NULL)
 		*count = cnt;
-	if (!list_empty(&referenced))
-		list_splice(&referenced, &sb->s_dentry_lru);
 	spin_unlock(&dcache_lock);
 }
 
@@ -538,7 +670,7 @@ static void prune_dcache(int count)
 {
 	struct super_block *sb, *p = NULL;
 	int w_count;
-	int unused = dentry_stat.nr_unused;
+	int unused = get_nr_dentry_unused();
 	int prune_ratio;
 	int pruned;
 
@@ -742,8 +874,9 @@ void shrink_dcache_for_umount(struct super_block *sb)
 	atomic_dec(&dentry->d_count);
 	shrink_dcache_for_umount_subtree(dentry);
 
-	while (!hlist_empty(&sb->s_anon)) {
-		dentry = hlist_entry(sb->s_anon.first, struct dentry, d_hash);
+	while (!hlist_bl_empty(&sb->s_anon)) {
+		dentry = hlist_bl_entry(hlist_bl_first(&sb->s_anon),
+					struct dentry, d_hash);
 		shrink_dcache_for_umount_subtree(dentry);
 	}
 }
@@ -830,6 +963,7 @@ resume:
 		struct dentry *dentry = list_entry(tmp, struct dentry, d_u.d_child);
 		next = tmp->next;
 
+		spin_lock(&dentry->d_lock);
 		dentry_lru_del_init(dentry);
 		/* 
 		 * move only zero ref count dentries to the end 
@@ -839,6 +973,7 @@ resume:
 			dentry_lru_add_tail(dentry);
 			found++;
 		}
+		spin_unlock(&dentry->d_lock);
 
 		/*
 		 * We can return to the caller if we have found some (this
@@ -905,7 +1040,7 @@ static int shrink_dcache_memory(struct shrinker *shrink, int nr, gfp_t gfp_mask)
 			return -1;
 		prune_dcache(nr);
 	}
-	return (dentry_stat.nr_unused / 100) * sysctl_vfs_cache_pressure;
+	return (get_nr_dentry_unused() / 100) * sysctl_vfs_cache_pressure;
 }
 
 static struct shrinker dcache_shrinker = {
@@ -951,13 +1086,14 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 	atomic_set(&dentry->d_count, 1);
 	dentry->d_flags = DCACHE_UNHASHED;
 	spin_lock_init(&dentry->d_lock);
+	seqcount_init(&dentry->d_seq);
 	dentry->d_inode = NULL;
 	dentry->d_parent = NULL;
 	dentry->d_sb = NULL;
 	dentry->d_op = NULL;
 	dentry->d_fsdata = NULL;
 	dentry->d_mounted = 0;
-	INIT_HLIST_NODE(&dentry->d_hash);
+	INIT_HLIST_BL_NODE(&dentry->d_hash);
 	INIT_LIST_HEAD(&dentry->d_lru);
 	INIT_LIST_HEAD(&dentry->d_subdirs);
 	INIT_LIST_HEAD(&dentry->d_alias);
@@ -993,9 +1129,13 @@ EXPORT_SYMBOL(d_alloc_name);
 /* the caller must hold dcache_lock */
 static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 {
+	spin_lock(&dentry->d_lock);
 	if (inode)
 		list_add(&dentry->d_alias, &inode->i_dentry);
+	write_seqcount_begin(&dentry->d_seq);
 	dentry->d_inode = inode;
+	write_seqcount_end(&dentry->d_seq);
+	spin_unlock(&dentry->d_lock);
 	fsnotify_d_instantiate(dentry, inode);
 }
 
@@ -1121,14 +1261,6 @@ struct dentry * d_alloc_root(struct inode * root_inode)
 }
 EXPORT_SYMBOL(d_alloc_root);
 
-static inline struct hlist_head *d_hash(struct dentry *parent,
-					unsigned long hash)
-{
-	hash += ((unsigned long) parent ^ GOLDEN_RATIO_PRIME) / L1_CACHE_BYTES;
-	hash = hash ^ ((hash ^ GOLDEN_RATIO_PRIME) >> D_HASHBITS);
-	return dentry_hashtable + (hash & D_HASHMASK);
-}
-
 /**
  * d_obtain_alias - find or allocate a dentry for a given inode
  * @inode: inode to allocate the dentry for
@@ -1184,7 +1316,9 @@ struct dentry *d_obtain_alias(struct inode *inode)
 	tmp->d_flags |= DCACHE_DISCONNECTED;
 	tmp->d_flags &= ~DCACHE_UNHASHED;
 	list_add(&tmp->d_alias, &inode->i_dentry);
-	hlist_add_head(&tmp->d_hash, &inode->i_sb->s_anon);
+	hlist_bl_lock(&tmp->d_sb->s_anon);
+	hlist_bl_add_head(&tmp->d_hash, &tmp->d_sb->s_anon);
+	hlist_bl_unlock(&tmp->d_sb->s_anon);
 	spin_unlock(&tmp->d_lock);
 
 	spin_unlock(&dcache_lock);
@@ -1374,9 +1508,9 @@ struct dentry * __d_lookup(struct dentry * parent, struct qstr * name)
 	unsigned int len = name->len;
 	unsigned int hash = name->hash;
 	const unsigned char *str = name->name;
-	struct hlist_head *head = d_hash(parent,hash);
+	struct hlist_bl_head *b = d_hash(parent, hash);
 	struct dentry *found = NULL;
-	struct hlist_node *node;
+	struct hlist_bl_node *node;
 	struct dentry *dentry;
 
 	/*
@@ -1394,7 +1528,7 @@ struct dentry * __d_lookup(struct dentry * parent, struct qstr * name)
 	 */
 	rcu_read_lock();
 	
-	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+	hlist_bl_for_each_entry_rcu(dentry, node, b, d_hash) {
 		struct qstr *qstr;
 
 		if (dentry->d_name.hash != hash)
@@ -1443,6 +1577,59 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking references
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ * @seq: returns the d_seq of the found dentry
+ * Returns: dentry, or NULL
+ *
+ * __d_lookup_rcu is the rcu-walk variant of __d_lookup.  It takes neither
+ * d_lock nor a reference on the dentry it returns, so the caller must be
+ * in an rcu_read_lock() section and must check @seq with
+ * read_seqcount_retry() before relying on anything it read from the
+ * dentry, including the name match.  Like __d_lookup it can return
+ * false negatives under concurrent renames.
+ *
+ * The parent must not have a ->d_compare(); the names are compared with
+ * memcmp().
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
+			      unsigned *seq)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_bl_head *b = d_hash(parent, hash);
+	struct hlist_bl_node *node;
+	struct dentry *dentry;
+
+	hlist_bl_for_each_entry_rcu(dentry, node, b, d_hash) {
+		const unsigned char *tname;
+		unsigned int tlen;
+		unsigned s;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+seqretry:
+		s = read_seqcount_begin(&dentry->d_seq);
+		if (dentry->d_parent != parent)
+			continue;
+		if (d_unhashed(dentry))
+			continue;
+		tlen = dentry->d_name.len;
+		tname = dentry->d_name.name;
+		/* the name and length must be from the same rename */
+		if (read_seqcount_retry(&dentry->d_seq, s))
+			goto seqretry;
+		if (tlen != len || memcmp(tname, str, len))
+			continue;
+		*seq = s;
+		return dentry;
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -1481,8 +1668,9 @@ out:
  
 int d_validate(struct dentry *dentry, struct dentry *dparent)
 {
-	struct hlist_head *base;
-	struct hlist_node *lhp;
+	struct hlist_bl_head *b;
+	struct hlist_bl_node *node;
+	struct dentry *d;
 
 	/* Check whether the ptr might be valid at all.. */
 	if (!kmem_ptr_validate(dentry_cache, dentry))
@@ -1492,17 +1680,18 @@ int d_validate(struct dentry *dentry, struct dentry *dparent)
 		goto out;
 
 	spin_lock(&dcache_lock);
-	base = d_hash(dparent, dentry->d_name.hash);
-	hlist_for_each(lhp,base) { 
-		/* hlist_for_each_entry_rcu() not required for d_hash list
-		 * as it is parsed under dcache_lock
-		 */
-		if (dentry == hlist_entry(lhp, struct dentry, d_hash)) {
+	b = d_hash(dparent, dentry->d_name.hash);
+	hlist_bl_lock(b);
+	hlist_bl_for_each_entry(d, node, b, d_hash) {
+		if (dentry == d) {
+			/* dcache_lock keeps it from being freed */
+			hlist_bl_unlock(b);
 			__dget_locked(dentry);
 			spin_unlock(&dcache_lock);
 			return 1;
 		}
 	}
+	hlist_bl_unlock(b);
 	spin_unlock(&dcache_lock);
 out:
 	return 0;
@@ -1556,11 +1745,12 @@ void d_delete(struct dentry * dentry)
 }
 EXPORT_SYMBOL(d_delete);
 
-static void __d_rehash(struct dentry * entry, struct hlist_head *list)
+static void __d_rehash(struct dentry * entry, struct hlist_bl_head *b)
 {
-
+	hlist_bl_lock(b);
  	entry->d_flags &= ~DCACHE_UNHASHED;
- 	hlist_add_head_rcu(&entry->d_hash, list);
+ 	hlist_bl_add_head_rcu(&entry->d_hash, b);
+	hlist_bl_unlock(b);
 }
 
 static void _d_rehash(struct dentry * entry)
@@ -1659,8 +1849,6 @@ static void switch_names(struct dentry *dentry, struct dentry *target)
  */
 static void d_move_locked(struct dentry * dentry, struct dentry * target)
 {
-	struct hlist_head *list;
-
 	if (!dentry->d_inode)
 		printk(KERN_WARNING "VFS: moving negative dcache entry\n");
 
@@ -1676,18 +1864,24 @@ static void d_move_locked(struct dentry * dentry, struct dentry * target)
 		spin_lock_nested(&target->d_lock, DENTRY_D_LOCK_NESTED);
 	}
 
-	/* Move the dentry to the target hash queue, if on different bucket */
-	if (d_unhashed(dentry))
-		goto already_unhashed;
+	/*
+	 * Unhash the target: dput() will then get rid of it.  __d_drop()
+	 * has its own d_seq write section, which must not nest in ours.
+	 */
+	__d_drop(target);
 
-	hlist_del_rcu(&dentry->d_hash);
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_begin(&target->d_seq);
 
-already_unhashed:
-	list = d_hash(target->d_parent, target->d_name.hash);
-	__d_rehash(dentry, list);
+	/* Move the dentry to the target hash queue */
+	if (!d_unhashed(dentry)) {
+		struct hlist_bl_head *b = d_hash_chain(dentry);
 
-	/* Unhash the target: dput() will then get rid of it */
-	__d_drop(target);
+		hlist_bl_lock(b);
+		hlist_bl_del_rcu(&dentry->d_hash);
+		hlist_bl_unlock(b);
+	}
+	__d_rehash(dentry, d_hash(target->d_parent, target->d_name.hash));
 
 	list_del(&dentry->d_u.d_child);
 	list_del(&target->d_u.d_child);
@@ -1709,6 +1903,10 @@ already_unhashed:
 	}
 
 	list_add(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
+
+	write_seqcount_end(&target->d_seq);
+	write_seqcount_end(&dentry->d_seq);
+
 	spin_unlock(&target->d_lock);
 	fsnotify_d_move(dentry);
 	spin_unlock(&dentry->d_lock);
@@ -1859,8 +2057,11 @@ struct dentry *d_materialise_unique(struct dentry *dentry, struct inode *inode)
 			 * into our tree? */
 			if (IS_ROOT(alias)) {
 				spin_lock(&alias->d_lock);
-				__d_materialise_dentry(dentry, alias);
+				/* unhash while it is still on the s_anon chain */
 				__d_drop(alias);
+				write_seqcount_begin(&alias->d_seq);
+				__d_materialise_dentry(dentry, alias);
+				write_seqcount_end(&alias->d_seq);
 				goto found;
 			}
 			/* Nope, but we must(!) avoid directory aliasing */
@@ -2403,7 +2604,7 @@ static void __init dcache_init_early(void)
 
 	dentry_hashtable =
 		alloc_large_system_hash("Dentry cache",
-					sizeof(struct hlist_head),
+					sizeof(struct hlist_bl_head),
 					dhash_entries,
 					13,
 					HASH_EARLY,
@@ -2412,7 +2613,7 @@ static void __init dcache_init_early(void)
 					0);
 
 	for (loop = 0; loop < (1 << d_hash_shift); loop++)
-		INIT_HLIST_HEAD(&dentry_hashtable[loop]);
+		INIT_HLIST_BL_HEAD(&dentry_hashtable[loop]);
 }
 
 static void __init dcache_init(void)
@@ -2435,7 +2636,7 @@ static void __init dcache_init(void)
 
 	dentry_hashtable =
 		alloc_large_system_hash("Dentry cache",
-					sizeof(struct hlist_head),
+					sizeof(struct hlist_bl_head),
 					dhash_entries,
 					13,
 					0,
@@ -2444,7 +2645,7 @@ static void __init dcache_init(void)
 					0);
 
 	for (loop = 0; loop < (1 << d_hash_shift); loop++)
-		INIT_HLIST_HEAD(&dentry_hashtable[loop]);
+		INIT_HLIST_BL_HEAD(&dentry_hashtable[loop]);
 }
 
 /* SLAB cache for __getname() consumers */
@@ -2198,7 +2198,8 @@ static int ext4_remove_blocks(handle_t *handle, struct inode *inode,
 
 static int
 ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
-		struct ext4_ext_path *path, ext4_lblk_t start)
+		struct ext4_ext_path *path, ext4_lblk_t start,
+		ext4_lblk_t end)
 {
 	int err = 0, correct_index = 0;
 	int depth = ext_depth(inode), credits;
@@ -2211,7 +2212,7 @@ ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
 	struct ext4_extent *ex;
 
 	/* the header must be checked already in ext4_ext_remove_space() */
-	ext_debug("truncate since %u in leaf\n", start);
+	ext_debug("truncate since %u to %u in leaf\n", start, end);
 	if (!path[depth].p_hdr)
 		path[depth].p_hdr = ext_block_hdr(path[depth].p_bh);
 	eh = path[depth].p_hdr;
@@ -2220,7 +2221,9 @@ ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
 		return -EIO;
 	}
 	/* find where to start removing */
-	ex = EXT_LAST_EXTENT(eh);
+	ex = path[depth].p_ext;
+	if (!ex)
+		ex = EXT_LAST_EXTENT(eh);
 
 	ex_ee_block = le32_to_cpu(ex->ee_block);
 	ex_ee_len = ext4_ext_get_actual_len(ex);
@@ -2238,12 +2241,18 @@ ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
 		path[depth].p_ext = ex;
 
 		a = ex_ee_block > start ? ex_ee_block : start;
-		b = ex_ee_block + ex_ee_len - 1 < EXT_MAX_BLOCK ?
-			ex_ee_block + ex_ee_len - 1 : EXT_MAX_BLOCK;
+		b = ex_ee_block + ex_ee_len - 1 < end ?
+			ex_ee_block + ex_ee_len - 1 : end;
 
 		ext_debug("  border %u:%u\n", a, b);
 
-		if (a != ex_ee_block && b != ex_ee_block + ex_ee_len - 1) {
+		/* If this extent is beyond the end of the hole, skip it */
+		if (end < ex_ee_block) {
+			ex--;
+			ex_ee_block = le32_to_cpu(ex->ee_block);
+			ex_ee_len = ext4_ext_get_actual_len(ex);
+			continue;
+		} else if (a != ex_ee_block && b != ex_ee_block + ex_ee_len - 1) {
 			block = 0;
 			num = 0;
 			BUG();
@@ -2293,7 +2302,6 @@ ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
 		if (num == 0) {
 			/* this extent is removed; mark slot entirely unused */
 			ext4_ext_store_pblock(ex, 0);
-			le16_add_cpu(&eh->eh_entries, -1);
 		}
 
 		ex->ee_block = cpu_to_le32(block);
@@ -2305,6 +2313,21 @@ ext4_ext_rm_leaf(handle_t *handle, struct inode *inode,
 		if (uninitialized && num)
 			ext4_ext_mark_uninitialized(ex);
 
+		if (num == 0) {
+			/*
+			 * When punching a hole the removed extent may sit in
+			 * the middle of the leaf: shift the ones after it
+			 * down so that the leaf stays packed.
+			 */
+			if (end != EXT_MAX_BLOCK) {
+				memmove(ex, ex + 1, (EXT_LAST_EXTENT(eh) - ex) *
+					sizeof(struct ext4_extent));
+				memset(EXT_LAST_EXTENT(eh), 0,
+				       sizeof(struct ext4_extent));
+			}
+			le16_add_cpu(&eh->eh_entries, -1);
+		}
+
 		err = ext4_ext_dirty(handle, inode, path + depth);
 		if (err)
 			goto out;
@@ -2349,7 +2372,64 @@ ext4_ext_more_to_rm(struct ext4_ext_path *path)
 	return 1;
 }
 
-static int ext4_ext_remove_space(struct inode *inode, ext4_lblk_t start)
+/*
+ * ext4_split_extent_at:
+ * splits the extent at path[depth].p_ext in two at block @split, so that
+ * no extent crosses it.  Both halves keep the uninitialized state of the
+ * original; they are not merged back by ext4_ext_insert_extent().
+ */
+static int ext4_split_extent_at(handle_t *handle, struct inode *inode,
+				struct ext4_ext_path *path, ext4_lblk_t split)
+{
+	struct ext4_extent *ex, newex, orig_ex;
+	ext4_lblk_t ee_block;
+	unsigned int ee_len;
+	int depth, err;
+
+	depth = ext_depth(inode);
+	ex = path[depth].p_ext;
+	ee_block = le32_to_cpu(ex->ee_block);
+	ee_len = ext4_ext_get_actual_len(ex);
+
+	BUG_ON(split <= ee_block || split >= ee_block + ee_len);
+
+	err = ext4_ext_get_access(handle, inode, path + depth);
+	if (err)
+		return err;
+
+	orig_ex = *ex;
+	ex->ee_len = cpu_to_le16(split - ee_block);
+	if (ext4_ext_is_uninitialized(&orig_ex))
+		ext4_ext_mark_uninitialized(ex);
+	err = ext4_ext_dirty(handle, inode, path + depth);
+	if (err)
+		goto fix_extent_len;
+
+	newex.ee_block = cpu_to_le32(split);
+	newex.ee_len = cpu_to_le16(ee_len - (split - ee_block));
+	ext4_ext_store_pblock(&newex, ext_pblock(&orig_ex) + split - ee_block);
+	if (ext4_ext_is_uninitialized(&orig_ex))
+		ext4_ext_mark_uninitialized(&newex);
+
+	err = ext4_ext_insert_extent(handle, inode, path, &newex,
+				     EXT4_GET_BLOCKS_PRE_IO);
+	if (err)
+		goto fix_extent_len;
+	return 0;
+
+fix_extent_len:
+	ex->ee_len = orig_ex.ee_len;
+	ext4_ext_dirty(handle, inode, path + depth);
+	return err;
+}
+
+/*
+ * ext4_ext_remove_space:
+ * frees the blocks in [start, end]; end == EXT_MAX_BLOCK means everything
+ * from start on (truncate), otherwise a hole is punched.
+ */
+static int ext4_ext_remove_space(struct inode *inode, ext4_lblk_t start,
+				 ext4_lblk_t end)
 {
 	struct super_block *sb = inode->i_sb;
 	int depth = ext_depth(inode);
@@ -2357,7 +2437,7 @@ static int ext4_ext_remove_space(struct inode *inode, ext4_lblk_t start)
 	handle_t *handle;
 	int i, err;
 
-	ext_debug("truncate since %u\n", start);
+	ext_debug("truncate since %u to %u\n", start, end);
 
 	/* probably first extent we're gonna free will be last in block */
 	handle = ext4_journal_start(inode, depth + 1);
@@ -2367,28 +2447,72 @@ static int ext4_ext_remove_space(struct inode *inode, ext4_lblk_t start)
 again:
 	ext4_ext_invalidate_cache(inode);
 
-	/*
-	 * We start scanning from right side, freeing all the blocks
-	 * after i_size and walking into the tree depth-wise.
-	 */
-	depth = ext_depth(inode);
-	path = kzalloc(sizeof(struct ext4_ext_path) * (depth + 1), GFP_NOFS);
-	if (path == NULL) {
-		ext4_journal_stop(handle);
-		return -ENOMEM;
-	}
-	path[0].p_depth = depth;
-	path[0].p_hdr = ext_inode_hdr(inode);
-	if (ext4_ext_check(inode, path[0].p_hdr, depth)) {
-		err = -EIO;
-		goto out;
+	if (end != EXT_MAX_BLOCK) {
+		struct ext4_extent *ex;
+		ext4_lblk_t ee_block;
+
+		/*
+		 * Punching a hole: make sure no extent crosses the end of
+		 * the hole, then scan leftwards from the leaf holding it.
+		 */
+		path = ext4_ext_find_extent(inode, end, NULL);
+		if (IS_ERR(path)) {
+			ext4_journal_stop(handle);
+			return PTR_ERR(path);
+		}
+		depth = ext_depth(inode);
+		ex = path[depth].p_ext;
+		if (ex) {
+			ee_block = le32_to_cpu(ex->ee_block);
+			if (end >= ee_block &&
+			    end < ee_block + ext4_ext_get_actual_len(ex) - 1) {
+				err = ext4_ext_truncate_extend_restart(handle,
+					inode, ext4_ext_calc_credits_for_single_extent(
+							inode, 1, path));
+				if (!err)
+					err = ext4_split_extent_at(handle, inode,
+								   path, end + 1);
+				ext4_ext_drop_refs(path);
+				kfree(path);
+				if (err && err != -EAGAIN) {
+					ext4_journal_stop(handle);
+					return err;
+				}
+				goto again;
+			}
+		}
+		/* every index is to be considered, see ext4_ext_more_to_rm() */
+		for (i = 0; i < depth; i++)
+			path[i].p_block =
+				le16_to_cpu(path[i].p_hdr->eh_entries) + 1;
+		i = depth;
+	} else {
+		/*
+		 * We start scanning from right side, freeing all the blocks
+		 * after i_size and walking into the tree depth-wise.
+		 */
+		depth = ext_depth(inode);
+		path = kzalloc(sizeof(struct ext4_ext_path) * (depth + 1),
+			       GFP_NOFS);
+		if (path == NULL) {
+			ext4_journal_stop(handle);
+			return -ENOMEM;
+		}
+		path[0].p_depth = depth;
+		path[0].p_hdr = ext_inode_hdr(inode);
+		if (ext4_ext_check(inode, path[0].p_hdr, depth)) {
+			err = -EIO;
+			goto out;
+		}
+		i = 0;
 	}
-	i = err = 0;
+	err = 0;
 
 	while (i >= 0 && err == 0) {
 		if (i == depth) {
 			/* this is leaf block */
-			err = ext4_ext_rm_leaf(handle, inode, path, start);
+			err = ext4_ext_rm_leaf(handle, inode, path,
+					       start, end);
 			/* root level has p_bh == NULL, brelse() eats this */
 			brelse(path[i].p_bh);
 			path[i].p_bh = NULL;
@@ -3611,7 +3735,7 @@ void ext4_ext_truncate(struct inode *inode)
 
 	last_block = (inode->i_size + sb->s_blocksize - 1)
 			>> EXT4_BLOCK_SIZE_BITS(sb);
-	err = ext4_ext_remove_space(inode, last_block);
+	err = ext4_ext_remove_space(inode, last_block, EXT_MAX_BLOCK);
 
 	/* In a multi-transaction truncate, we only make the final
 	 * transaction synchronous.
@@ -3666,6 +3790,110 @@ static void ext4_falloc_update_inode(struct inode *inode,
 
 }
 
+/*
+ * Zero [from, to) through the page cache, one block at a time.
+ */
+static int ext4_ext_zero_partial_blocks(handle_t *handle, struct inode *inode,
+					loff_t from, loff_t to)
+{
+	unsigned blocksize = inode->i_sb->s_blocksize;
+	loff_t len;
+	int err = 0;
+
+	while (from < to && !err) {
+		len = min_t(loff_t, to - from,
+			    blocksize - (from & (blocksize - 1)));
+		err = ext4_block_zero_page_range(handle, inode->i_mapping,
+						 from, len);
+		from += len;
+	}
+	return err;
+}
+
+/*
+ * ext4_ext_punch_hole
+ *
+ * Punches a hole of "length" bytes in a file starting at byte "offset".
+ * The blocks backing whole pages inside the hole are freed; the partial
+ * pages at either end are zeroed in place, so that no buffer_head is left
+ * pointing at a freed block.  The file size is not changed.
+ */
+static long ext4_ext_punch_hole(struct inode *inode, loff_t offset,
+				loff_t length)
+{
+	struct address_space *mapping = inode->i_mapping;
+	unsigned int blkbits = inode->i_blkbits;
+	loff_t first_page_offset, last_page_offset;
+	loff_t head_end, tail_start, end;
+	handle_t *handle;
+	int credits, err = 0;
+
+	/* No need to punch hole beyond i_size */
+	if (offset >= inode->i_size)
+		return 0;
+
+	end = offset + length;
+	if (end > EXT4_BLOCK_ALIGN(inode->i_size, blkbits))
+		end = EXT4_BLOCK_ALIGN(inode->i_size, blkbits);
+
+	/*
+	 * Write out all dirty pages in the hole first, so that no delayed
+	 * allocation gets to allocate blocks in it after we're done.
+	 */
+	if (mapping->nrpages && mapping_tagged(mapping, PAGECACHE_TAG_DIRTY)) {
+		err = filemap_write_and_wait_range(mapping, offset, end - 1);
+		if (err)
+			return err;
+	}
+
+	first_page_offset = round_up(offset, PAGE_CACHE_SIZE);
+	last_page_offset = round_down(end, PAGE_CACHE_SIZE);
+	head_end = min(first_page_offset, end);
+	tail_start = max(last_page_offset, head_end);
+
+	/* Now release the pages that are entirely in the hole */
+	if (last_page_offset > first_page_offset) {
+		unmap_mapping_range(mapping, first_page_offset,
+				    last_page_offset - first_page_offset, 1);
+		truncate_inode_pages_range(mapping, first_page_offset,
+					   last_page_offset - 1);
+	}
+
+	credits = 2 * ext4_writepage_trans_blocks(inode);
+	handle = ext4_journal_start(inode, credits);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	err = ext4_ext_zero_partial_blocks(handle, inode, offset, head_end);
+	if (!err)
+		err = ext4_ext_zero_partial_blocks(handle, inode,
+						   tail_start, end);
+	if (err)
+		goto out;
+
+	if (last_page_offset > first_page_offset) {
+		down_write(&EXT4_I(inode)->i_data_sem);
+		ext4_ext_invalidate_cache(inode);
+		ext4_discard_preallocations(inode);
+
+		err = ext4_ext_remove_space(inode,
+					    first_page_offset >> blkbits,
+					    (last_page_offset >> blkbits) - 1);
+
+		ext4_ext_invalidate_cache(inode);
+		up_write(&EXT4_I(inode)->i_data_sem);
+	}
+
+	if (IS_SYNC(inode))
+		ext4_handle_sync(handle);
+
+	inode->i_mtime = inode->i_ctime = ext4_current_time(inode);
+	ext4_mark_inode_dirty(handle, inode);
+out:
+	ext4_journal_stop(handle);
+	return err;
+}
+
 /*
  * preallocate space for a file. This implements ext4's fallocate inode
  * operation, which gets called from sys_fallocate system call.
@@ -3695,6 +3923,16 @@ long ext4_fallocate(struct inode *inode, int mode, loff_t offset, loff_t len)
 	if (S_ISDIR(inode->i_mode))
 		return -ENODEV;
 
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
+		return -EOPNOTSUPP;
+
+	if (mode & FALLOC_FL_PUNCH_HOLE) {
+		mutex_lock(&inode->i_mutex);
+		ret = ext4_ext_punch_hole(inode, offset, len);
+		mutex_unlock(&inode->i_mutex);
+		return ret;
+	}
+
 	map.m_lblk = offset >> blkbits;
 	/*
 	 * We can't just convert len to max_blocks because
@@ -3757,6 +3995,77 @@ retry:
 	return ret > 0 ? ret2 : ret;
 }
 
+/*
+ * ext4_ext_seek_data_hole:
+ * returns the offset of the next data (SEEK_DATA) or hole (SEEK_HOLE) at or
+ * after @offset, looked up in the extent tree.  Uninitialized extents count
+ * as data.  Dirty pages are written out first so that delayed allocations
+ * show up in the tree.  The end of the file is a virtual hole.
+ */
+loff_t ext4_ext_seek_data_hole(struct inode *inode, loff_t offset, int origin)
+{
+	struct address_space *mapping = inode->i_mapping;
+	unsigned int blkbits = inode->i_blkbits;
+	loff_t isize = i_size_read(inode);
+	struct ext4_ext_path *path;
+	struct ext4_extent *ex;
+	ext4_lblk_t lblk, last, ee_block, next;
+	int depth, data, found = 0;
+	int err;
+
+	if (offset < 0 || offset >= isize)
+		return -ENXIO;
+
+	if (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY)) {
+		err = filemap_write_and_wait_range(mapping, offset, LLONG_MAX);
+		if (err)
+			return err;
+	}
+
+	lblk = offset >> blkbits;
+	last = (isize - 1) >> blkbits;
+
+	down_read(&EXT4_I(inode)->i_data_sem);
+	for (;;) {
+		path = ext4_ext_find_extent(inode, lblk, NULL);
+		if (IS_ERR(path)) {
+			up_read(&EXT4_I(inode)->i_data_sem);
+			return PTR_ERR(path);
+		}
+		depth = ext_depth(inode);
+		ex = path[depth].p_ext;
+		ee_block = ex ? le32_to_cpu(ex->ee_block) : 0;
+
+		if (ex && lblk >= ee_block &&
+		    lblk < ee_block + ext4_ext_get_actual_len(ex)) {
+			data = 1;
+			next = ee_block + ext4_ext_get_actual_len(ex);
+		} else {
+			data = 0;
+			if (ex && ee_block > lblk)
+				next = ee_block;
+			else
+				next = ext4_ext_next_allocated_block(path);
+		}
+		ext4_ext_drop_refs(path);
+		kfree(path);
+
+		if (data == (origin == SEEK_DATA)) {
+			found = 1;
+			break;
+		}
+		if (next == EXT_MAX_BLOCK || next > last)
+			break;
+		lblk = next;
+	}
+	up_read(&EXT4_I(inode)->i_data_sem);
+
+	if (!found)
+		return origin == SEEK_HOLE ? isize : -ENXIO;
+
+	return max_t(loff_t, offset, (loff_t)lblk << blkbits);
+}
+
 /*
  * This function convert a range of blocks to written extents
  * The caller of this function will pass the start offset and the size.
@@ -130,8 +130,32 @@ static int ext4_file_open(struct inode * inode, struct file * filp)
 	return dquot_file_open(inode, filp);
 }
 
+/*
+ * SEEK_DATA and SEEK_HOLE are answered from the extent tree for extent
+ * mapped files; everything else is generic_file_llseek().
+ */
+static loff_t ext4_file_llseek(struct file *file, loff_t offset, int origin)
+{
+	struct inode *inode = file->f_mapping->host;
+	loff_t retval;
+
+	if ((origin != SEEK_DATA && origin != SEEK_HOLE) ||
+	    !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))
+		return generic_file_llseek(file, offset, origin);
+
+	mutex_lock(&inode->i_mutex);
+	retval = ext4_ext_seek_data_hole(inode, offset, origin);
+	if (retval >= 0 && retval != file->f_pos) {
+		file->f_pos = retval;
+		file->f_version = 0;
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	return retval;
+}
+
 const struct file_operations ext4_file_operations = {
-	.llseek		= generic_file_llseek,
+	.llseek		= ext4_file_llseek,
 	.read		= do_sync_read,
 	.write		= do_sync_write,
 	.aio_read	= generic_file_aio_read,
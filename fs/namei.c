@@ -977,6 +977,322 @@ return_err:
 	return err;
 }
 
+/*
+ * rcu-walk: resolve a path without touching d_lock or d_count on the way.
+ *
+ * The whole walk runs under rcu_read_lock() and the vfsmount_lock read
+ * side, so neither dentries nor vfsmounts can be freed under us.  Every
+ * dentry we look at is sampled with its d_seq, and nothing read from it
+ * (its name, parent or inode) is trusted until d_seq has been rechecked
+ * after moving on.  Only the final dentry and vfsmount get a reference.
+ *
+ * Anything we cannot do without blocking or without a reference --
+ * ->d_hash, ->d_compare, ->d_revalidate, ->permission, ACLs, symlinks,
+ * cache misses -- makes us give up with -ECHILD, and the caller redoes
+ * the whole lookup in ref-walk mode.  The same goes for filesystems whose
+ * inodes may be freed without waiting for a grace period.
+ */
+static inline int rcu_walk_sb(struct super_block *sb)
+{
+	return !sb->s_op->destroy_inode ||
+		(sb->s_type->fs_flags & FS_RCU_INODES);
+}
+
+static int exec_permission_rcu(struct inode *inode)
+{
+	umode_t mode = inode->i_mode;
+
+	if (inode->i_op->permission)
+		return -ECHILD;
+#ifdef CONFIG_SECURITY
+	/* the LSM blob is freed without waiting for a grace period */
+	if (inode->i_security)
+		return -ECHILD;
+#endif
+	if (current_fsuid() == inode->i_uid)
+		mode >>= 6;
+	else {
+		if (IS_POSIXACL(inode) && (mode & S_IRWXG) &&
+		    inode->i_op->check_acl)
+			return -ECHILD;
+		if (in_group_p(inode->i_gid))
+			mode >>= 3;
+	}
+	if (!(mode & MAY_EXEC) &&
+	    !capable(CAP_DAC_OVERRIDE) && !capable(CAP_DAC_READ_SEARCH))
+		return -ECHILD;
+
+	/* on any failure, let ref-walk work out and report the error */
+	if (security_inode_permission(inode, MAY_EXEC))
+		return -ECHILD;
+	return 0;
+}
+
+static int follow_mount_rcu(struct path *path, unsigned *seq,
+			    struct inode **inode)
+{
+	while (d_mountpoint(path->dentry)) {
+		struct vfsmount *mounted;
+
+		mounted = __lookup_mnt(path->mnt, path->dentry, 1);
+		if (!mounted)
+			break;
+		if (!rcu_walk_sb(mounted->mnt_sb))
+			return -ECHILD;
+		path->mnt = mounted;
+		path->dentry = mounted->mnt_root;
+		*seq = read_seqcount_begin(&path->dentry->d_seq);
+		*inode = path->dentry->d_inode;
+	}
+	return 0;
+}
+
+static int follow_dotdot_rcu(struct path *path, struct path *root,
+			     unsigned *seq, struct inode **inode)
+{
+	while (1) {
+		if (path->dentry == root->dentry && path->mnt == root->mnt)
+			break;
+		if (path->dentry != path->mnt->mnt_root) {
+			struct dentry *parent = path->dentry->d_parent;
+			unsigned pseq = read_seqcount_begin(&parent->d_seq);
+
+			if (read_seqcount_retry(&path->dentry->d_seq, *seq))
+				return -ECHILD;
+			path->dentry = parent;
+			*seq = pseq;
+			break;
+		}
+		if (path->mnt->mnt_parent == path->mnt)
+			break;
+		if (!rcu_walk_sb(path->mnt->mnt_parent->mnt_sb))
+			return -ECHILD;
+		path->dentry = path->mnt->mnt_mountpoint;
+		path->mnt = path->mnt->mnt_parent;
+		*seq = read_seqcount_begin(&path->dentry->d_seq);
+	}
+	*inode = path->dentry->d_inode;
+	return follow_mount_rcu(path, seq, inode);
+}
+
+static int do_lookup_rcu(struct path *path, struct qstr *name,
+			 unsigned *seq, struct inode **inode)
+{
+	struct dentry *parent = path->dentry;
+	struct dentry *dentry;
+	unsigned dseq;
+
+	if (parent->d_op && (parent->d_op->d_hash || parent->d_op->d_compare))
+		return -ECHILD;
+
+	dentry = __d_lookup_rcu(parent, name, &dseq);
+	if (!dentry)
+		return -ECHILD;
+	if (dentry->d_op && dentry->d_op->d_revalidate)
+		return -ECHILD;
+	*inode = dentry->d_inode;
+	if (read_seqcount_retry(&dentry->d_seq, dseq))
+		return -ECHILD;
+	/* the parent was still where we thought when we found the child */
+	if (read_seqcount_retry(&parent->d_seq, *seq))
+		return -ECHILD;
+
+	path->dentry = dentry;
+	*seq = dseq;
+	return follow_mount_rcu(path, seq, inode);
+}
+
+/*
+ * Take references on the result of an rcu-walk.  Holding d_lock keeps
+ * dput() from killing the dentry between the d_seq check and the
+ * increment, just as in __d_lookup().
+ */
+static int path_get_rcu(struct path *path, unsigned seq)
+{
+	struct dentry *dentry = path->dentry;
+
+	spin_lock(&dentry->d_lock);
+	if (!dentry->d_inode || read_seqcount_retry(&dentry->d_seq, seq)) {
+		spin_unlock(&dentry->d_lock);
+		return -ECHILD;
+	}
+	atomic_inc(&dentry->d_count);
+	spin_unlock(&dentry->d_lock);
+	mntget(path->mnt);
+	return 0;
+}
+
+/*
+ * Try to resolve @name in rcu-walk mode.  Only lookups starting at the
+ * current root or cwd are attempted.  Returns -ECHILD if the caller has
+ * to fall back to path_init() and link_path_walk(); any other return
+ * value is the final result of the lookup, with nd->path referenced on
+ * success just as after a ref-walk.
+ */
+static int path_walk_rcu(int dfd, const char *name, unsigned int flags,
+			 struct nameidata *nd)
+{
+	struct fs_struct *fs = current->fs;
+	unsigned int lookup_flags = flags;
+	struct path root, path;
+	struct inode *inode;
+	unsigned seq;
+	int err;
+
+	if (*name != '/' && dfd != AT_FDCWD)
+		return -ECHILD;
+
+	nd->last_type = LAST_ROOT;
+	nd->flags = flags;
+	nd->depth = 0;
+	nd->root.mnt = NULL;
+
+	br_read_lock(vfsmount_lock);
+	rcu_read_lock();
+
+	do {
+		seq = read_seqcount_begin(&fs->seq);
+		root = fs->root;
+		path = *name == '/' ? fs->root : fs->pwd;
+	} while (read_seqcount_retry(&fs->seq, seq));
+
+	err = -ECHILD;
+	if (!rcu_walk_sb(path.mnt->mnt_sb))
+		goto out;
+	seq = read_seqcount_begin(&path.dentry->d_seq);
+	inode = path.dentry->d_inode;
+
+	while (*name == '/')
+		name++;
+	if (!*name)
+		goto return_reval;
+
+	for (;;) {
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+
+		err = -ECHILD;
+		if (!inode)
+			break;
+		nd->flags |= LOOKUP_CONTINUE;
+		err = exec_permission_rcu(inode);
+		if (err)
+			break;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		if (!c)
+			goto last_component;
+		while (*++name == '/');
+		if (!*name)
+			goto last_with_slashes;
+
+		if (this.name[0] == '.') switch (this.len) {
+			default:
+				break;
+			case 2:
+				if (this.name[1] != '.')
+					break;
+				err = follow_dotdot_rcu(&path, &root, &seq, &inode);
+				if (err)
+					goto out;
+				/* fallthrough */
+			case 1:
+				continue;
+		}
+		err = do_lookup_rcu(&path, &this, &seq, &inode);
+		if (err)
+			break;
+		err = -ENOENT;
+		if (!inode)
+			break;
+		err = -ECHILD;
+		if (inode->i_op->follow_link)
+			break;
+		err = -ENOTDIR;
+		if (!inode->i_op->lookup)
+			break;
+		continue;
+
+last_with_slashes:
+		lookup_flags |= LOOKUP_FOLLOW | LOOKUP_DIRECTORY;
+last_component:
+		nd->flags &= lookup_flags | ~LOOKUP_CONTINUE;
+		if (lookup_flags & LOOKUP_PARENT)
+			goto lookup_parent;
+		if (this.name[0] == '.') switch (this.len) {
+			default:
+				break;
+			case 2:
+				if (this.name[1] != '.')
+					break;
+				err = follow_dotdot_rcu(&path, &root, &seq, &inode);
+				if (err)
+					goto out;
+				/* fallthrough */
+			case 1:
+				goto return_reval;
+		}
+		err = do_lookup_rcu(&path, &this, &seq, &inode);
+		if (err)
+			break;
+		err = -ENOENT;
+		if (!inode)
+			break;
+		err = -ECHILD;
+		if (follow_on_final(inode, lookup_flags))
+			break;
+		if (lookup_flags & LOOKUP_DIRECTORY) {
+			err = -ENOTDIR;
+			if (!inode->i_op->lookup)
+				break;
+		}
+		goto return_base;
+lookup_parent:
+		nd->last = this;
+		nd->last_type = LAST_NORM;
+		if (this.name[0] != '.')
+			goto return_base;
+		if (this.len == 1)
+			nd->last_type = LAST_DOT;
+		else if (this.len == 2 && this.name[1] == '.')
+			nd->last_type = LAST_DOTDOT;
+		else
+			goto return_base;
+return_reval:
+		err = -ECHILD;
+		if (path.dentry->d_sb->s_type->fs_flags & FS_REVAL_DOT)
+			break;
+return_base:
+		err = path_get_rcu(&path, seq);
+		if (!err)
+			nd->path = path;
+		break;
+	}
+	/*
+	 * Negative and non-directory results were read under rcu as well;
+	 * only report them if the dentry they came from was still valid.
+	 */
+	if ((err == -ENOENT || err == -ENOTDIR) &&
+	    read_seqcount_retry(&path.dentry->d_seq, seq))
+		err = -ECHILD;
+out:
+	rcu_read_unlock();
+	br_read_unlock(vfsmount_lock);
+	return err;
+}
+
 static int path_walk(const char *name, struct nameidata *nd)
 {
 	struct path save = nd->path;
@@ -1054,9 +1370,12 @@ out_fail:
 static int do_path_lookup(int dfd, const char *name,
 				unsigned int flags, struct nameidata *nd)
 {
-	int retval = path_init(dfd, name, flags, nd);
-	if (!retval)
-		retval = path_walk(name, nd);
+	int retval = path_walk_rcu(dfd, name, flags, nd);
+	if (retval == -ECHILD) {
+		retval = path_init(dfd, name, flags, nd);
+		if (!retval)
+			retval = path_walk(name, nd);
+	}
 	if (unlikely(!retval && !audit_dummy_context() && nd->path.dentry &&
 				nd->path.dentry->d_inode))
 		audit_inode(name, nd->path.dentry);
@@ -1775,14 +2094,19 @@ struct file *do_filp_open(int dfd, const char *pathname,
 
 	/* find the parent */
 reval:
-	error = path_init(dfd, pathname, LOOKUP_PARENT, &nd);
-	if (error)
-		return ERR_PTR(error);
-	if (force_reval)
-		nd.flags |= LOOKUP_REVAL;
-
 	current->total_link_count = 0;
-	error = link_path_walk(pathname, &nd);
+	error = -ECHILD;
+	if (!force_reval)
+		error = path_walk_rcu(dfd, pathname, LOOKUP_PARENT, &nd);
+	if (error == -ECHILD) {
+		error = path_init(dfd, pathname, LOOKUP_PARENT, &nd);
+		if (error)
+			return ERR_PTR(error);
+		if (force_reval)
+			nd.flags |= LOOKUP_REVAL;
+
+		error = link_path_walk(pathname, &nd);
+	}
 	if (error) {
 		filp = ERR_PTR(error);
 		goto out;
@@ -2608,6 +2608,26 @@ static int proc_base_fill_cache(struct file *filp, void *dirent,
 				proc_base_instantiate, task, p);
 }
 
+#ifdef CONFIG_KSM
+static int proc_pid_ksm_stat(struct task_struct *task, char *buffer)
+{
+	struct mm_struct *mm = get_task_mm(task);
+	int len = 0;
+
+	if (mm) {
+		len = sprintf(buffer,
+				"ksm_rmap_items %lu\n"
+				"ksm_merging_pages %lu\n"
+				"ksm_pages_scanned %lu\n"
+				"ksm_pages_skipped %lu\n",
+				mm->ksm_rmap_items, mm->ksm_merging_pages,
+				mm->ksm_pages_scanned, mm->ksm_pages_skipped);
+		mmput(mm);
+	}
+	return len;
+}
+#endif /* CONFIG_KSM */
+
 #ifdef CONFIG_TASK_IO_ACCOUNTING
 static int do_io_accounting(struct task_struct *task, char *buffer, int whole)
 {
@@ -2739,6 +2759,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_TASK_IO_ACCOUNTING
 	INF("io",	S_IRUGO, proc_tgid_io_accounting),
 #endif
+#ifdef CONFIG_KSM
+	INF("ksm_stat",	S_IRUGO, proc_pid_ksm_stat),
+#endif
 };
 
 static int proc_tgid_base_readdir(struct file * filp,
@@ -905,8 +905,90 @@ xfs_vm_page_mkwrite(
 	return block_page_mkwrite(vma, vmf, xfs_get_blocks);
 }
 
+/*
+ * Find the next data or hole offset at or after @start by walking the data
+ * fork mappings.  Delayed allocations and unwritten extents count as data,
+ * and the end of the file is a virtual hole.
+ */
+STATIC loff_t
+xfs_seek_data_hole(
+	struct xfs_inode	*ip,
+	loff_t			start,
+	int			origin)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	loff_t			isize = i_size_read(VFS_I(ip));
+	xfs_fileoff_t		fsbno, end;
+	xfs_bmbt_irec_t		map;
+	loff_t			offset = -ENXIO;
+	uint			lock;
+	int			nmap;
+	int			error;
+	int			data;
+
+	if (start < 0 || start >= isize)
+		return -ENXIO;
+
+	lock = xfs_ilock_map_shared(ip);
+
+	fsbno = XFS_B_TO_FSBT(mp, start);
+	end = XFS_B_TO_FSB(mp, isize);
+	while (fsbno < end) {
+		nmap = 1;
+		error = xfs_bmapi(NULL, ip, fsbno, end - fsbno, 0, NULL, 0,
+				  &map, &nmap, NULL);
+		if (error) {
+			offset = -error;
+			goto out_unlock;
+		}
+		if (!nmap)
+			break;
+
+		data = (map.br_startblock != HOLESTARTBLOCK);
+		if (data == (origin == SEEK_DATA)) {
+			offset = max_t(loff_t, start,
+				       XFS_FSB_TO_B(mp, map.br_startoff));
+			goto out_unlock;
+		}
+		fsbno = map.br_startoff + map.br_blockcount;
+	}
+
+	/* no more data: the end of the file is a virtual hole */
+	if (origin == SEEK_HOLE)
+		offset = isize;
+
+out_unlock:
+	xfs_iunlock_map_shared(ip, lock);
+	if (offset > isize)
+		offset = isize;
+	return offset;
+}
+
+STATIC loff_t
+xfs_file_llseek(
+	struct file		*file,
+	loff_t			offset,
+	int			origin)
+{
+	struct inode		*inode = file->f_mapping->host;
+	loff_t			retval;
+
+	if (origin != SEEK_DATA && origin != SEEK_HOLE)
+		return generic_file_llseek(file, offset, origin);
+
+	mutex_lock(&inode->i_mutex);
+	retval = xfs_seek_data_hole(XFS_I(inode), offset, origin);
+	if (retval >= 0 && retval != file->f_pos) {
+		file->f_pos = retval;
+		file->f_version = 0;
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	return retval;
+}
+
 const struct file_operations xfs_file_operations = {
-	.llseek		= generic_file_llseek,
+	.llseek		= xfs_file_llseek,
 	.read		= do_sync_read,
 	.write		= do_sync_write,
 	.aio_read	= xfs_file_aio_read,
@@ -2,10 +2,12 @@
 #define _LINUX_FS_STRUCT_H
 
 #include <linux/path.h>
+#include <linux/seqlock.h>
 
 struct fs_struct {
 	int users;
 	spinlock_t lock;
+	seqcount_t seq;		/* root/pwd changes, for rcu-walk */
 	int umask;
 	int in_exec;
 	struct path root, pwd;
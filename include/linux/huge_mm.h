@@ -0,0 +1,125 @@
+#ifndef _LINUX_HUGE_MM_H
+#define _LINUX_HUGE_MM_H
+
+/*
+ * Transparent huge pages for anonymous memory.
+ *
+ * A transparent huge page is HPAGE_PMD_NR naturally aligned, physically
+ * contiguous order-0 pages mapped by a single pmd.  Every subpage keeps
+ * its own refcount, mapcount, LRU position and anon rmap, so only the
+ * page table walkers need to know about huge pmds: anything that wants
+ * to look at individual ptes splits the pmd first, which never fails
+ * since a page table is deposited when the huge pmd is established.
+ */
+
+struct mmu_gather;
+
+extern int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+				      struct vm_area_struct *vma,
+				      unsigned long address, pmd_t *pmd,
+				      unsigned int flags);
+extern int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+			 pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
+			 struct vm_area_struct *vma);
+extern int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+			pmd_t *pmd, unsigned long addr);
+extern struct page *follow_trans_huge_pmd(struct mm_struct *mm,
+					  unsigned long addr, pmd_t *pmd,
+					  unsigned int flags);
+extern int mincore_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+			    unsigned long addr, unsigned long end,
+			    unsigned char *vec);
+extern int huge_pmd_set_accessed(struct mm_struct *mm, unsigned long address,
+				 pmd_t *pmd, pmd_t orig_pmd);
+
+enum transparent_hugepage_flag {
+	TRANSPARENT_HUGEPAGE_FLAG,
+	TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+};
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define HPAGE_PMD_SHIFT PMD_SHIFT
+#define HPAGE_PMD_SIZE	((1UL) << HPAGE_PMD_SHIFT)
+#define HPAGE_PMD_MASK	(~(HPAGE_PMD_SIZE - 1))
+#define HPAGE_PMD_ORDER (HPAGE_PMD_SHIFT-PAGE_SHIFT)
+#define HPAGE_PMD_NR (1<<HPAGE_PMD_ORDER)
+
+extern unsigned long transparent_hugepage_flags;
+
+extern int huge_pmd_referenced(struct page *page, struct vm_area_struct *vma,
+			       unsigned long address);
+
+/*
+ * Whether faults in @__vma may be served with a huge pmd, according
+ * to the sysfs policy and to MADV_HUGEPAGE/MADV_NOHUGEPAGE.
+ */
+#define transparent_hugepage_enabled(__vma)				\
+	((transparent_hugepage_flags &					\
+	  (1<<TRANSPARENT_HUGEPAGE_FLAG) ||				\
+	  (transparent_hugepage_flags &					\
+	   (1<<TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG) &&			\
+	   ((__vma)->vm_flags & VM_HUGEPAGE))) &&			\
+	 !((__vma)->vm_flags & VM_NOHUGEPAGE))
+
+extern void __split_huge_pmd(struct mm_struct *mm, pmd_t *pmd,
+			     unsigned long address);
+#define split_huge_pmd(__mm, __pmd, __address)				\
+	do {								\
+		if (unlikely(pmd_trans_huge(*(__pmd))))			\
+			__split_huge_pmd(__mm, __pmd, __address);	\
+	} while (0)
+extern void split_huge_pmd_address(struct mm_struct *mm,
+				   unsigned long address);
+
+extern int hugepage_madvise(struct vm_area_struct *vma,
+			    unsigned long *vm_flags, int advice);
+extern void __vma_adjust_trans_huge(struct vm_area_struct *vma,
+				    unsigned long start,
+				    unsigned long end,
+				    long adjust_next);
+static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
+					 unsigned long start,
+					 unsigned long end,
+					 long adjust_next)
+{
+	if (!vma->anon_vma || vma->vm_ops)
+		return;
+	__vma_adjust_trans_huge(vma, start, end, adjust_next);
+}
+
+#else /* CONFIG_TRANSPARENT_HUGEPAGE */
+#define HPAGE_PMD_SHIFT ({ BUG(); 0; })
+#define HPAGE_PMD_MASK ({ BUG(); 0; })
+#define HPAGE_PMD_SIZE ({ BUG(); 0; })
+
+#define transparent_hugepage_enabled(__vma) 0
+
+#define split_huge_pmd(__mm, __pmd, __address)				\
+	do { } while (0)
+static inline void split_huge_pmd_address(struct mm_struct *mm,
+					  unsigned long address)
+{
+}
+
+static inline int hugepage_madvise(struct vm_area_struct *vma,
+				   unsigned long *vm_flags, int advice)
+{
+	BUG();
+	return 0;
+}
+static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
+					 unsigned long start,
+					 unsigned long end,
+					 long adjust_next)
+{
+}
+
+static inline int huge_pmd_referenced(struct page *page,
+				      struct vm_area_struct *vma,
+				      unsigned long address)
+{
+	return -1;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+#endif /* _LINUX_HUGE_MM_H */
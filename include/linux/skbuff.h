@@ -170,6 +170,8 @@ struct skb_shared_hwtstamps {
  * @in_progress:	device driver is going to provide
  *			hardware time stamp
  * @prevent_sk_orphan:	make sk reference available on driver level
+ * @dev_zerocopy:	frags are pinned user pages, destructor_arg points
+ *			to a &struct ubuf_info to be told when they are freed
  * @flags:		all shared_tx flags
  *
  * These flags are attached to packets as part of the
@@ -180,11 +182,23 @@ union skb_shared_tx {
 		__u8	hardware:1,
 			software:1,
 			in_progress:1,
-			prevent_sk_orphan:1;
+			prevent_sk_orphan:1,
+			dev_zerocopy:1;
 	};
 	__u8 flags;
 };
 
+/*
+ * The callback notifies userspace to release buffers when skb DMA is done in
+ * lower device, the skb last reference should be 0 when calling this.
+ * The desc is used to track userspace buffer index.
+ */
+struct ubuf_info {
+	void (*callback)(struct ubuf_info *);
+	void *arg;
+	unsigned long desc;
+};
+
 /* This data is invariant across clones and lives at
  * the end of the header data, ie. at skb->end.
  */
@@ -380,8 +394,8 @@ struct sk_buff {
 
 	__u32			rxhash;
 
+	__u16			queue_mapping;
 	kmemcheck_bitfield_begin(flags2);
-	__u16			queue_mapping:16;
 #ifdef CONFIG_IPV6_NDISC_NODETYPE
 	__u8			ndisc_nodetype:2,
 				deliver_no_wcard:1;
@@ -516,6 +530,7 @@ extern struct sk_buff *skb_copy(const struct sk_buff *skb,
 				gfp_t priority);
 extern struct sk_buff *pskb_copy(struct sk_buff *skb,
 				 gfp_t gfp_mask);
+extern int	       skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask);
 extern int	       pskb_expand_head(struct sk_buff *skb,
 					int nhead, int ntail,
 					gfp_t gfp_mask);
@@ -157,11 +157,22 @@ enum {
 
 #define SWAP_MAP_MAX	0x3e	/* Max duplication count, in first swap_map */
 #define SWAP_MAP_BAD	0x3f	/* Note pageblock is bad, in first swap_map */
+#define SWAP_MAP_RESERVED SWAP_MAP_BAD	/* Held free in a per-cpu cluster */
 #define SWAP_HAS_CACHE	0x40	/* Flag page is cached, in first swap_map */
 #define SWAP_CONT_MAX	0x7f	/* Max count, in each swap_map continuation */
 #define COUNT_CONTINUED	0x80	/* See swap_map continuation for full count */
 #define SWAP_MAP_SHMEM	0xbf	/* Owned by shmem/tmpfs, in first swap_map */
 
+/*
+ * Usage of each SWAPFILE_CLUSTER-sized, aligned cluster of an SSD swap
+ * area. Clusters with no slot in use are kept on free_clusters, from which
+ * whole clusters are handed out to cpus for lockless allocation.
+ */
+struct swap_cluster_info {
+	struct list_head list;		/* on free_clusters while count is 0 */
+	unsigned int count;		/* slots in use, bad or reserved */
+};
+
 /*
  * The in-memory structure used to track swap areas.
  */
@@ -180,6 +191,8 @@ struct swap_info_struct {
 	unsigned int cluster_nr;	/* countdown to next cluster search */
 	unsigned int lowest_alloc;	/* while preparing discard cluster */
 	unsigned int highest_alloc;	/* while preparing discard cluster */
+	struct swap_cluster_info *cluster_info; /* SSD only, else NULL */
+	struct list_head free_clusters;	/* clusters with count 0 */
 	struct swap_extent *curr_swap_extent;
 	struct swap_extent first_swap_extent;
 	struct block_device *bdev;	/* swap device or bdev of swap file */
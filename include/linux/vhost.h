@@ -102,6 +102,10 @@ struct vhost_memory {
 #define VHOST_SET_VRING_BASE _IOW(VHOST_VIRTIO, 0x12, struct vhost_vring_state)
 /* Get accessor: reads index, writes value in num */
 #define VHOST_GET_VRING_BASE _IOWR(VHOST_VIRTIO, 0x12, struct vhost_vring_state)
+/* Get the pid of the worker thread serving the ring: reads index, writes
+ * the pid in num.  Rings of one TX/RX pair share a worker, so userspace can
+ * pin it next to the vcpu that drives the pair. */
+#define VHOST_GET_VRING_WORKER _IOWR(VHOST_VIRTIO, 0x13, struct vhost_vring_state)
 
 /* The following ioctls use eventfd file descriptors to signal and poll
  * for events. */
@@ -118,7 +122,8 @@ struct vhost_memory {
 /* Attach virtio net ring to a raw socket, or tap device.
  * The socket must be already bound to an ethernet device, this device will be
  * used for transmit.  Pass fd -1 to unbind from the socket and the transmit
- * device.  This can be used to stop the ring (e.g. for migration). */
+ * device.  This can be used to stop the ring (e.g. for migration).
+ * Ring 2n is the receive and ring 2n + 1 the transmit queue of pair n. */
 #define VHOST_NET_SET_BACKEND _IOW(VHOST_VIRTIO, 0x30, struct vhost_vring_file)
 
 /* Feature bits */
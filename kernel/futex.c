@@ -2012,6 +2012,251 @@ uaddr_faulted:
 	goto retry;
 }
 
+/*
+ * Adaptive spinning futex lock:
+ *
+ * The futex value holds the TID of the owner (0 if unlocked), and the
+ * FUTEX_WAITERS bit once somebody is blocked in the kernel. Userspace
+ * locks with a 0 -> TID cmpxchg and unlocks with a TID -> 0 cmpxchg; if
+ * the latter fails because FUTEX_WAITERS is set, it stores 0 and does a
+ * FUTEX_WAKE of one waiter. There is no PI here, so the owner is only
+ * used as a hint: while it runs on another cpu it will likely release
+ * the lock soon, and spinning for that is much cheaper than two context
+ * switches.
+ */
+
+/**
+ * futex_lock_atomic() - Atomic work required to acquire a FUTEX_LOCK futex
+ * @uaddr:		the futex user address
+ * @hb:			the futex hash bucket
+ * @key:		the futex key associated with uaddr and hb
+ * @uval:		storage for the futex value seen if the lock is busy
+ * @set_waiters:	set the FUTEX_WAITERS bit if the lock is busy (1) or
+ *			not (0)
+ *
+ * Returns:
+ *  0 - lock is busy, *uval holds the owner value
+ *  1 - acquired the lock
+ * <0 - error
+ *
+ * The hb->lock and futex_key refs shall be held by the caller.
+ */
+static int futex_lock_atomic(u32 __user *uaddr, struct futex_hash_bucket *hb,
+			     union futex_key *key, u32 *uval, int set_waiters)
+{
+	u32 vpid = task_pid_vnr(current);
+	u32 newval, curval;
+	struct futex_q *this;
+	int waiters = 0;
+
+	/*
+	 * If other tasks are queued on this futex, the new owner has to
+	 * keep FUTEX_WAITERS set so that its unlock wakes one of them.
+	 */
+	plist_for_each_entry(this, &hb->chain, list) {
+		if (match_futex(&this->key, key)) {
+			waiters = 1;
+			break;
+		}
+	}
+
+	if (get_futex_value_locked(&curval, uaddr))
+		return -EFAULT;
+
+	for (;;) {
+		if (unlikely((curval & FUTEX_TID_MASK) == vpid))
+			return -EDEADLK;
+
+		if (!(curval & FUTEX_TID_MASK))
+			newval = vpid | (waiters ? FUTEX_WAITERS : 0);
+		else if (set_waiters && !(curval & FUTEX_WAITERS))
+			newval = curval | FUTEX_WAITERS;
+		else
+			break;
+
+		*uval = curval;
+		curval = cmpxchg_futex_value_locked(uaddr, *uval, newval);
+		if (unlikely(curval == -EFAULT))
+			return -EFAULT;
+		if (curval != *uval)
+			continue;
+		if (!(curval & FUTEX_TID_MASK))
+			return 1;
+		curval = newval;
+		break;
+	}
+
+	*uval = curval;
+	return 0;
+}
+
+#ifdef CONFIG_SMP
+/**
+ * futex_spin_on_owner() - Spin while the futex owner is running
+ * @uaddr:	the futex user address
+ * @uval:	the futex value seen by futex_lock_atomic()
+ * @to:		the started timeout, or NULL
+ *
+ * Must be called without the hb->lock held.
+ *
+ * Returns:
+ *  1 - the futex value changed, retry the lock
+ *  0 - the owner is not running (or we should reschedule, or the timeout
+ *      expired), go to sleep
+ */
+static int futex_spin_on_owner(u32 __user *uaddr, u32 uval,
+			       struct hrtimer_sleeper *to)
+{
+	struct task_struct *owner;
+	u32 curval;
+	int ret = 0;
+
+	rcu_read_lock();
+	owner = find_task_by_vpid(uval & FUTEX_TID_MASK);
+	if (owner)
+		get_task_struct(owner);
+	rcu_read_unlock();
+
+	if (!owner)
+		return 0;
+
+	while (task_curr(owner) && !need_resched() &&
+	       !signal_pending(current) && (!to || to->task)) {
+		if (get_user(curval, uaddr))
+			break;
+		if (curval != uval) {
+			ret = 1;
+			break;
+		}
+		cpu_relax();
+	}
+
+	put_task_struct(owner);
+	return ret;
+}
+#else
+static inline int futex_spin_on_owner(u32 __user *uaddr, u32 uval,
+				      struct hrtimer_sleeper *to)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Userspace tried a 0 -> TID atomic transition of a FUTEX_LOCK futex and
+ * failed. Spin while the owner is running, then block until the lock is
+ * released and try again.
+ */
+static int futex_lock(u32 __user *uaddr, int fshared, ktime_t *time,
+		      int clockrt)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_hash_bucket *hb;
+	struct futex_q q;
+	int spin = 1;
+	u32 uval;
+	int ret;
+
+	if (time) {
+		to = &timeout;
+		hrtimer_init_on_stack(&to->timer, clockrt ? CLOCK_REALTIME :
+				      CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *time,
+					     current->timer_slack_ns);
+		/* Arm it now, so that spinning can not outlast it either */
+		hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+		if (!hrtimer_active(&to->timer))
+			to->task = NULL;
+	}
+
+	q.pi_state = NULL;
+	q.bitset = FUTEX_BITSET_MATCH_ANY;
+	q.rt_waiter = NULL;
+	q.requeue_pi_key = NULL;
+retry:
+	q.key = FUTEX_KEY_INIT;
+	ret = get_futex_key(uaddr, fshared, &q.key);
+	if (unlikely(ret != 0))
+		goto out;
+
+retry_private:
+	hb = queue_lock(&q);
+
+	ret = futex_lock_atomic(uaddr, hb, &q.key, &uval, !spin);
+	if (unlikely(ret)) {
+		switch (ret) {
+		case 1:
+			/* We got the lock. */
+			ret = 0;
+			goto out_unlock_put_key;
+		case -EFAULT:
+			goto uaddr_faulted;
+		default:
+			goto out_unlock_put_key;
+		}
+	}
+
+	if (spin) {
+		queue_unlock(&q, hb);
+		spin = futex_spin_on_owner(uaddr, uval, to);
+		ret = -ETIMEDOUT;
+		if (to && !to->task)
+			goto out_put_key;
+		goto again;
+	}
+
+	/*
+	 * FUTEX_WAITERS is set and we hold hb->lock, so the owner's wakeup
+	 * can not get lost between here and queue_me().
+	 */
+	futex_wait_queue_me(hb, &q, to);
+
+	/*
+	 * If we were woken the lock was released: try to get it, and spin
+	 * again if somebody else beat us to it.
+	 */
+	if (!unqueue_me(&q)) {
+		spin = 1;
+		goto again;
+	}
+	ret = -ETIMEDOUT;
+	if (to && !to->task)
+		goto out_put_key;
+	ret = -EINTR;
+	if (signal_pending(current))
+		goto out_put_key;
+
+	/* Spurious wakeup, go back to sleep. */
+	goto again;
+
+out_unlock_put_key:
+	queue_unlock(&q, hb);
+
+out_put_key:
+	put_futex_key(fshared, &q.key);
+out:
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+	return ret != -EINTR ? ret : -ERESTARTNOINTR;
+
+uaddr_faulted:
+	queue_unlock(&q, hb);
+
+	ret = fault_in_user_writeable(uaddr);
+	if (ret)
+		goto out_put_key;
+
+again:
+	if (!fshared)
+		goto retry_private;
+
+	put_futex_key(fshared, &q.key);
+	goto retry;
+}
+
 /*
  * Userspace attempted a TID -> 0 atomic transition, and failed.
  * This is the in-kernel slowpath: we look up the PI state (if any),
@@ -2550,7 +2795,8 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		fshared = 1;
 
 	clockrt = op & FUTEX_CLOCK_REALTIME;
-	if (clockrt && cmd != FUTEX_WAIT_BITSET && cmd != FUTEX_WAIT_REQUEUE_PI)
+	if (clockrt && cmd != FUTEX_WAIT_BITSET &&
+	    cmd != FUTEX_WAIT_REQUEUE_PI && cmd != FUTEX_LOCK)
 		return -ENOSYS;
 
 	switch (cmd) {
@@ -2595,6 +2841,10 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		ret = futex_requeue(uaddr, fshared, uaddr2, val, val2, &val3,
 				    1);
 		break;
+	case FUTEX_LOCK:
+		if (futex_cmpxchg_enabled)
+			ret = futex_lock(uaddr, fshared, timeout, clockrt);
+		break;
 	default:
 		ret = -ENOSYS;
 	}
@@ -2613,7 +2863,7 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI || cmd == FUTEX_LOCK)) {
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
 			return -EFAULT;
 		if (!timespec_valid(&ts))
@@ -0,0 +1,1345 @@
+/*
+ * Transparent huge pages for anonymous memory.
+ *
+ * Anonymous memory in suitably aligned areas is faulted in with a
+ * single pmd mapping HPAGE_PMD_NR physically contiguous small pages,
+ * and khugepaged collapses existing small pages into such mappings in
+ * the background.  The small pages making up a huge page are never
+ * tied together: each one keeps its own refcount, mapcount, anon rmap
+ * and LRU position, so everything that needs to look at them one by
+ * one just splits the pmd into ptes, which cannot fail.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/hugetlb.h>
+#include <linux/mmu_notifier.h>
+#include <linux/rmap.h>
+#include <linux/swap.h>
+#include <linux/mman.h>
+#include <linux/mempolicy.h>
+#include <linux/memcontrol.h>
+#include <linux/kthread.h>
+#include <linux/khugepaged.h>
+#include <linux/ksm.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <asm/tlb.h>
+#include <asm/pgalloc.h>
+#include "internal.h"
+
+/*
+ * By default transparent hugepage support is enabled for all mappings
+ * or only for those marked with MADV_HUGEPAGE, as chosen at build
+ * time; both can be changed through sysfs.
+ */
+unsigned long transparent_hugepage_flags __read_mostly =
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE_ALWAYS
+	(1<<TRANSPARENT_HUGEPAGE_FLAG);
+#else
+	(1<<TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG);
+#endif
+
+/* Number of ptes khugepaged should scan in one batch */
+static unsigned int khugepaged_pages_to_scan __read_mostly = HPAGE_PMD_NR*8;
+
+/* Milliseconds khugepaged should sleep between batches */
+static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
+
+/* Milliseconds khugepaged should wait after a huge page allocation failed */
+static unsigned int khugepaged_alloc_sleep_millisecs __read_mostly = 60000;
+
+/* How many empty ptes a range may have and still be collapsed */
+static unsigned int khugepaged_max_ptes_none __read_mostly = HPAGE_PMD_NR-1;
+
+static unsigned int khugepaged_pages_collapsed;
+static unsigned int khugepaged_full_scans;
+
+static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
+static DEFINE_SPINLOCK(khugepaged_mm_lock);
+
+#define MM_SLOTS_HASH_SHIFT 10
+#define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
+static struct hlist_head mm_slots_hash[MM_SLOTS_HASH_HEADS];
+static struct kmem_cache *mm_slot_cache __read_mostly;
+
+/**
+ * struct mm_slot - khugepaged information per mm that is being scanned
+ * @hash: link to the mm_slots hash list
+ * @mm_node: link into the mm_slots list, rooted in khugepaged_scan.mm_head
+ * @mm: the mm that this information is valid for
+ */
+struct mm_slot {
+	struct hlist_node hash;
+	struct list_head mm_node;
+	struct mm_struct *mm;
+};
+
+/**
+ * struct khugepaged_scan - cursor for scanning
+ * @mm_head: the head of the mm list to scan
+ * @mm_slot: the current mm_slot we are scanning
+ * @address: the next address inside that to be scanned
+ *
+ * There is only the one khugepaged_scan instance of this cursor structure.
+ * The list and the cursor are protected by khugepaged_mm_lock.
+ */
+struct khugepaged_scan {
+	struct list_head mm_head;
+	struct mm_slot *mm_slot;
+	unsigned long address;
+};
+static struct khugepaged_scan khugepaged_scan = {
+	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
+};
+
+#define khugepaged_enabled()					\
+	(transparent_hugepage_flags &				\
+	 ((1<<TRANSPARENT_HUGEPAGE_FLAG) |			\
+	  (1<<TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG)))
+
+/* Mappings that never get huge pmds */
+#define VM_NO_THP (VM_SPECIAL|VM_INSERTPAGE|VM_MIXEDMAP|VM_SAO|		\
+		   VM_HUGETLB|VM_SHARED|VM_MAYSHARE|VM_NONLINEAR|	\
+		   VM_GROWSDOWN|VM_GROWSUP)
+
+static inline int khugepaged_test_exit(struct mm_struct *mm)
+{
+	return atomic_read(&mm->mm_users) == 0;
+}
+
+static int hugepage_vma_check(struct vm_area_struct *vma)
+{
+	if (vma->vm_ops || (vma->vm_flags & VM_NO_THP))
+		return 0;
+	/* huge pages are allocated following the task policy only */
+	if (vma_policy(vma))
+		return 0;
+	return 1;
+}
+
+static struct page *alloc_hugepage(void)
+{
+	struct page *page;
+
+	page = alloc_pages(GFP_HIGHUSER_MOVABLE | __GFP_NORETRY | __GFP_NOWARN,
+			   HPAGE_PMD_ORDER);
+	if (page)
+		split_page(page, HPAGE_PMD_ORDER);
+	return page;
+}
+
+static void free_hugepage(struct page *page)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		__free_page(page + i);
+}
+
+static void uncharge_hugepage(struct page *page, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		mem_cgroup_uncharge_page(page + i);
+}
+
+static int charge_hugepage(struct page *page, struct mm_struct *mm)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (unlikely(mem_cgroup_newpage_charge(page + i, mm,
+						       GFP_KERNEL))) {
+			uncharge_hugepage(page, i);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Every huge pmd has a page table deposited for it, so that splitting
+ * it never needs to allocate memory.  The deposited tables are
+ * interchangeable and kept on a per-mm list.
+ */
+static void prepare_pmd_huge_pte(pgtable_t pgtable, struct mm_struct *mm)
+{
+	assert_spin_locked(&mm->page_table_lock);
+	list_add(&pgtable->lru, &mm->pmd_huge_pte);
+}
+
+static pgtable_t get_pmd_huge_pte(struct mm_struct *mm)
+{
+	pgtable_t pgtable;
+
+	assert_spin_locked(&mm->page_table_lock);
+	VM_BUG_ON(list_empty(&mm->pmd_huge_pte));
+	pgtable = list_first_entry(&mm->pmd_huge_pte, struct page, lru);
+	list_del(&pgtable->lru);
+	return pgtable;
+}
+
+static pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+
+	return pmd_offset(pud, address);
+}
+
+int do_huge_pmd_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			       unsigned long address, pmd_t *pmd,
+			       unsigned int flags)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t entry;
+	int i;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	if (!hugepage_vma_check(vma))
+		return VM_FAULT_FALLBACK;
+	if (unlikely(anon_vma_prepare(vma)))
+		return VM_FAULT_OOM;
+	if (unlikely(khugepaged_enter_vma(vma)))
+		return VM_FAULT_OOM;
+
+	page = alloc_hugepage();
+	if (unlikely(!page)) {
+		count_vm_event(THP_FAULT_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+	if (unlikely(charge_hugepage(page, mm))) {
+		free_hugepage(page);
+		count_vm_event(THP_FAULT_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable)) {
+		uncharge_hugepage(page, HPAGE_PMD_NR);
+		free_hugepage(page);
+		return VM_FAULT_OOM;
+	}
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		clear_user_highpage(page + i, haddr + i * PAGE_SIZE);
+		__SetPageUptodate(page + i);
+	}
+
+	entry = mk_pmd(page, vma->vm_page_prot);
+	if (likely(vma->vm_flags & VM_WRITE))
+		entry = pmd_mkwrite(pmd_mkdirty(entry));
+	entry = pmd_mkhuge(entry);
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		uncharge_hugepage(page, HPAGE_PMD_NR);
+		free_hugepage(page);
+		pte_free(mm, pgtable);
+		return 0;
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_new_anon_rmap(page + i, vma, haddr + i * PAGE_SIZE);
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_ANONPAGES, HPAGE_PMD_NR);
+	mm->nr_ptes++;
+	spin_unlock(&mm->page_table_lock);
+
+	count_vm_event(THP_FAULT_ALLOC);
+	return 0;
+}
+
+/*
+ * Called by fork with both mmap_sems held for writing.  Returns -EAGAIN
+ * if the source pmd got split meanwhile: the caller copies the ptes.
+ */
+int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
+		  struct vm_area_struct *vma)
+{
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t pmd;
+	int i, ret;
+
+	pgtable = pte_alloc_one(dst_mm, addr);
+	if (unlikely(!pgtable))
+		return -ENOMEM;
+
+	spin_lock(&dst_mm->page_table_lock);
+	spin_lock_nested(&src_mm->page_table_lock, SINGLE_DEPTH_NESTING);
+
+	ret = -EAGAIN;
+	pmd = *src_pmd;
+	if (unlikely(!pmd_trans_huge(pmd)))
+		goto out_unlock;
+
+	page = pmd_page(pmd);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		get_page(page + i);
+		page_dup_rmap(page + i);
+	}
+	add_mm_counter(dst_mm, MM_ANONPAGES, HPAGE_PMD_NR);
+
+	/* both sides COW from now on, through the split pte path */
+	pmdp_set_wrprotect(src_mm, addr, src_pmd);
+	pmd = pmd_mkold(pmd_wrprotect(pmd));
+	set_pmd_at(dst_mm, addr, dst_pmd, pmd);
+	prepare_pmd_huge_pte(pgtable, dst_mm);
+	dst_mm->nr_ptes++;
+	pgtable = NULL;
+
+	ret = 0;
+out_unlock:
+	spin_unlock(&src_mm->page_table_lock);
+	spin_unlock(&dst_mm->page_table_lock);
+	if (pgtable)
+		pte_free(dst_mm, pgtable);
+	return ret;
+}
+
+/*
+ * Returns 0 if the pmd got split meanwhile and the caller has to zap
+ * the ptes instead.
+ */
+int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+		 pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t orig_pmd;
+	int i;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return 0;
+	}
+	orig_pmd = pmdp_get_and_clear(mm, addr, pmd);
+	pgtable = get_pmd_huge_pte(mm);
+	page = pmd_page(orig_pmd);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page_remove_rmap(page + i);
+		tlb_remove_page(tlb, page + i);
+	}
+	add_mm_counter(mm, MM_ANONPAGES, -HPAGE_PMD_NR);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+
+	pte_free(mm, pgtable);
+	return 1;
+}
+
+struct page *follow_trans_huge_pmd(struct mm_struct *mm, unsigned long addr,
+				   pmd_t *pmd, unsigned int flags)
+{
+	struct page *page;
+
+	assert_spin_locked(&mm->page_table_lock);
+
+	/* let the caller fault: the write fault splits the pmd */
+	if ((flags & FOLL_WRITE) && !pmd_write(*pmd))
+		return NULL;
+
+	page = pmd_page(*pmd) + ((addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT);
+	/* writable huge pmds are always dirty, see the fault handler */
+	if (flags & FOLL_TOUCH)
+		mark_page_accessed(page);
+	if (flags & FOLL_GET)
+		get_page(page);
+	return page;
+}
+
+int mincore_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+		     unsigned long addr, unsigned long end,
+		     unsigned char *vec)
+{
+	int ret = 0;
+
+	spin_lock(&vma->vm_mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd))) {
+		memset(vec, 1, (end - addr) >> PAGE_SHIFT);
+		ret = 1;
+	}
+	spin_unlock(&vma->vm_mm->page_table_lock);
+	return ret;
+}
+
+/*
+ * A write fault on a huge pmd that is writable already was spurious: it
+ * raced with another cpu, or hit a stale TLB entry.  Just mark the pmd
+ * young and dirty and return 1.  Returns 0 if the pmd is write protected
+ * and must be split for the pte code to do the COW.
+ */
+int huge_pmd_set_accessed(struct mm_struct *mm, unsigned long address,
+			  pmd_t *pmd, pmd_t orig_pmd)
+{
+	if (!pmd_write(orig_pmd))
+		return 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_val(*pmd) == pmd_val(orig_pmd)))
+		set_pmd_at(mm, address & HPAGE_PMD_MASK, pmd,
+			   pmd_mkdirty(pmd_mkyoung(orig_pmd)));
+	spin_unlock(&mm->page_table_lock);
+	return 1;
+}
+
+/*
+ * Replace a huge pmd by a page table mapping the same pages with the
+ * same protections.  The pmd is left non-present but still huge while
+ * the TLB is flushed, so that nobody walking the page tables without
+ * page_table_lock can mistake it for a page table or for a hole.
+ */
+void __split_huge_pmd(struct mm_struct *mm, pmd_t *pmd,
+		      unsigned long address)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgtable_t pgtable;
+	pmd_t old, _pmd;
+	pte_t *pte;
+	int i;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
+	old = pmdp_invalidate(mm, haddr, pmd);
+
+	pgtable = get_pmd_huge_pte(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+	pte = pte_offset_map(&_pmd, haddr);
+	for (i = 0; i < HPAGE_PMD_NR; i++, haddr += PAGE_SIZE)
+		set_pte_at(mm, haddr, pte + i,
+			   pfn_pte(pmd_pfn(old) + i, pmd_pgprot(old)));
+	pte_unmap(pte);
+
+	smp_wmb(); /* make the ptes visible before the pmd */
+	pmd_populate(mm, pmd, pgtable);
+	spin_unlock(&mm->page_table_lock);
+
+	count_vm_event(THP_SPLIT);
+}
+
+void split_huge_pmd_address(struct mm_struct *mm, unsigned long address)
+{
+	pmd_t *pmd;
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd)
+		return;
+	split_huge_pmd(mm, pmd, address);
+}
+
+/*
+ * Called by vma_adjust() before moving the vma boundaries: a huge pmd
+ * must never straddle two vmas.
+ */
+void __vma_adjust_trans_huge(struct vm_area_struct *vma,
+			     unsigned long start,
+			     unsigned long end,
+			     long adjust_next)
+{
+	if (start & ~HPAGE_PMD_MASK &&
+	    (start & HPAGE_PMD_MASK) >= vma->vm_start &&
+	    (start & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
+		split_huge_pmd_address(vma->vm_mm, start);
+
+	if (end & ~HPAGE_PMD_MASK &&
+	    (end & HPAGE_PMD_MASK) >= vma->vm_start &&
+	    (end & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
+		split_huge_pmd_address(vma->vm_mm, end);
+
+	if (adjust_next > 0) {
+		struct vm_area_struct *next = vma->vm_next;
+		unsigned long nstart = next->vm_start;
+
+		nstart += adjust_next << PAGE_SHIFT;
+		if (nstart & ~HPAGE_PMD_MASK &&
+		    (nstart & HPAGE_PMD_MASK) >= next->vm_start &&
+		    (nstart & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= next->vm_end)
+			split_huge_pmd_address(next->vm_mm, nstart);
+	}
+}
+
+/*
+ * The page_referenced() step for a page mapped by a huge pmd: returns
+ * -1 if @page is not mapped by a huge pmd at @address, otherwise
+ * whether the pmd was young.  There is only one accessed bit for all
+ * the subpages, and reclaim tends to look at them in order, so it is
+ * only cleared when the last subpage is checked.
+ */
+int huge_pmd_referenced(struct page *page, struct vm_area_struct *vma,
+			unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	unsigned long index = (address - haddr) >> PAGE_SHIFT;
+	int referenced = -1;
+	pmd_t *pmd;
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || !pmd_trans_huge(*pmd))
+		return -1;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_trans_huge(*pmd) && pmd_page(*pmd) + index == page) {
+		referenced = pmd_young(*pmd) ? 1 : 0;
+		if (referenced && index == HPAGE_PMD_NR - 1)
+			pmdp_clear_flush_young(vma, haddr, pmd);
+	}
+	spin_unlock(&mm->page_table_lock);
+	return referenced;
+}
+
+int hugepage_madvise(struct vm_area_struct *vma,
+		     unsigned long *vm_flags, int advice)
+{
+	switch (advice) {
+	case MADV_HUGEPAGE:
+		if (*vm_flags & VM_NO_THP)
+			return -EINVAL;
+		*vm_flags &= ~VM_NOHUGEPAGE;
+		*vm_flags |= VM_HUGEPAGE;
+		/* let khugepaged collapse what was faulted in before */
+		if (unlikely(khugepaged_enter_vma(vma)))
+			return -ENOMEM;
+		break;
+	case MADV_NOHUGEPAGE:
+		if (*vm_flags & VM_NO_THP)
+			return -EINVAL;
+		*vm_flags &= ~VM_HUGEPAGE;
+		*vm_flags |= VM_NOHUGEPAGE;
+		break;
+	}
+
+	return 0;
+}
+
+static inline struct mm_slot *alloc_mm_slot(void)
+{
+	if (!mm_slot_cache)	/* initialization failed */
+		return NULL;
+	return kmem_cache_zalloc(mm_slot_cache, GFP_KERNEL);
+}
+
+static inline void free_mm_slot(struct mm_slot *mm_slot)
+{
+	kmem_cache_free(mm_slot_cache, mm_slot);
+}
+
+static struct mm_slot *get_mm_slot(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	struct hlist_head *bucket;
+	struct hlist_node *node;
+
+	bucket = &mm_slots_hash[hash_ptr(mm, MM_SLOTS_HASH_SHIFT)];
+	hlist_for_each_entry(mm_slot, node, bucket, hash) {
+		if (mm == mm_slot->mm)
+			return mm_slot;
+	}
+	return NULL;
+}
+
+static void insert_to_mm_slots_hash(struct mm_struct *mm,
+				    struct mm_slot *mm_slot)
+{
+	struct hlist_head *bucket;
+
+	bucket = &mm_slots_hash[hash_ptr(mm, MM_SLOTS_HASH_SHIFT)];
+	mm_slot->mm = mm;
+	hlist_add_head(&mm_slot->hash, bucket);
+}
+
+int __khugepaged_enter(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int wakeup;
+
+	mm_slot = alloc_mm_slot();
+	if (!mm_slot)
+		return -ENOMEM;
+
+	spin_lock(&khugepaged_mm_lock);
+	/* concurrent faults in the same mm may race to get here */
+	if (unlikely(test_and_set_bit(MMF_VM_HUGEPAGE, &mm->flags))) {
+		spin_unlock(&khugepaged_mm_lock);
+		free_mm_slot(mm_slot);
+		return 0;
+	}
+	insert_to_mm_slots_hash(mm, mm_slot);
+	wakeup = list_empty(&khugepaged_scan.mm_head);
+	list_add_tail(&mm_slot->mm_node, &khugepaged_scan.mm_head);
+	atomic_inc(&mm->mm_count);
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (wakeup)
+		wake_up_interruptible(&khugepaged_wait);
+
+	return 0;
+}
+
+int khugepaged_enter_vma(struct vm_area_struct *vma)
+{
+	if (!test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags) &&
+	    khugepaged_enabled())
+		return __khugepaged_enter(vma->vm_mm);
+	return 0;
+}
+
+void __khugepaged_exit(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int easy_to_free = 0;
+
+	/*
+	 * If khugepaged is not looking at this mm, free its mm_slot
+	 * right away.  Otherwise use mmap_sem to wait for khugepaged to
+	 * get out of the page tables, and leave the mm_slot for it to
+	 * free once it notices the mm exiting.
+	 */
+	spin_lock(&khugepaged_mm_lock);
+	mm_slot = get_mm_slot(mm);
+	if (mm_slot && khugepaged_scan.mm_slot != mm_slot) {
+		hlist_del(&mm_slot->hash);
+		list_del(&mm_slot->mm_node);
+		easy_to_free = 1;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (easy_to_free) {
+		clear_bit(MMF_VM_HUGEPAGE, &mm->flags);
+		free_mm_slot(mm_slot);
+		mmdrop(mm);
+	} else if (mm_slot) {
+		down_write(&mm->mmap_sem);
+		up_write(&mm->mmap_sem);
+	}
+}
+
+static void release_pte_pages(struct vm_area_struct *vma,
+			      unsigned long address, pte_t *pte, pte_t *end)
+{
+	struct page *page;
+
+	for (; pte < end; pte++, address += PAGE_SIZE) {
+		if (!pte_present(*pte))
+			continue;
+		page = vm_normal_page(vma, address, *pte);
+		if (!page)
+			continue;
+		dec_zone_page_state(page, NR_ISOLATED_ANON);
+		putback_lru_page(page);
+	}
+}
+
+/*
+ * Take all the pages mapped by @pte off the LRU, so that reclaim can't
+ * get a reference on them behind our back.  Only anonymous pages that
+ * are mapped nowhere else and not referenced by anybody else qualify.
+ */
+static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
+					unsigned long address, pte_t *pte)
+{
+	unsigned long _address = address;
+	struct page *page;
+	pte_t *_pte;
+	int none = 0;
+
+	for (_pte = pte; _pte < pte+HPAGE_PMD_NR;
+	     _pte++, _address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+
+		if (pte_none(pteval)) {
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out;
+		}
+		if (!pte_present(pteval))
+			goto out;
+		page = vm_normal_page(vma, _address, pteval);
+		if (!page) {	/* the zero page */
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out;
+		}
+		if (!PageAnon(page) || PageKsm(page) || PageSwapCache(page) ||
+		    page_mapcount(page) != 1)
+			goto out;
+		if (isolate_lru_page(page))
+			goto out;
+		/* the mapping and the isolation are the only references */
+		if (page_count(page) != 2) {
+			putback_lru_page(page);
+			goto out;
+		}
+		inc_zone_page_state(page, NR_ISOLATED_ANON);
+	}
+	return 1;
+
+out:
+	release_pte_pages(vma, address, pte, _pte);
+	return 0;
+}
+
+/*
+ * Copy the isolated pages into the new huge page and free them, zero
+ * filling the holes.  Returns the number of anonymous pages replaced.
+ */
+static int __collapse_huge_page_copy(pte_t *pte, struct page *page,
+				     struct vm_area_struct *vma,
+				     unsigned long address,
+				     spinlock_t *ptl)
+{
+	pte_t *_pte;
+	int nr_anon = 0;
+
+	for (_pte = pte; _pte < pte+HPAGE_PMD_NR;
+	     _pte++, page++, address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+		struct page *src_page = NULL;
+
+		if (pte_present(pteval))
+			src_page = vm_normal_page(vma, address, pteval);
+		if (!src_page)
+			clear_user_highpage(page, address);
+		else {
+			copy_user_highpage(page, src_page, address, vma);
+			dec_zone_page_state(src_page, NR_ISOLATED_ANON);
+			putback_lru_page(src_page);
+			nr_anon++;
+		}
+		__SetPageUptodate(page);
+
+		/*
+		 * Nobody can reach the ptes any more, but preemption has
+		 * to be disabled for the per-cpu stats of page_remove_rmap.
+		 */
+		spin_lock(ptl);
+		pte_clear(vma->vm_mm, address, _pte);
+		if (src_page)
+			page_remove_rmap(src_page);
+		spin_unlock(ptl);
+		if (src_page)
+			free_page_and_swap_cache(src_page);
+	}
+	return nr_anon;
+}
+
+static int khugepaged_vma_check(struct vm_area_struct *vma)
+{
+	if (!vma->anon_vma || !hugepage_vma_check(vma) ||
+	    !transparent_hugepage_enabled(vma))
+		return 0;
+	/* the new pages would have to be mlocked */
+	if (vma->vm_flags & VM_LOCKED)
+		return 0;
+	return 1;
+}
+
+/*
+ * Called with mmap_sem held for reading, which is dropped.  The huge
+ * page is allocated, or reused from a previous failed attempt, before
+ * taking mmap_sem for writing, which keeps out page faults while the
+ * ptes are replaced.  *hpage is left for the next attempt unless the
+ * collapse succeeded, and is an error pointer if the allocation failed.
+ */
+static void collapse_huge_page(struct mm_struct *mm, unsigned long address,
+			       struct page **hpage)
+{
+	struct vm_area_struct *vma;
+	struct page *new_page;
+	pmd_t *pmd, _pmd, entry;
+	pgtable_t pgtable;
+	spinlock_t *ptl;
+	pte_t *pte;
+	unsigned long hstart, hend;
+	int isolated, nr_anon, i;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	up_read(&mm->mmap_sem);
+
+	if (!*hpage) {
+		*hpage = alloc_hugepage();
+		if (unlikely(!*hpage)) {
+			count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+			*hpage = ERR_PTR(-ENOMEM);
+			return;
+		}
+		count_vm_event(THP_COLLAPSE_ALLOC);
+	}
+	new_page = *hpage;
+
+	down_write(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		goto out;
+
+	vma = find_vma(mm, address);
+	if (!vma)
+		goto out;
+	hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+	hend = vma->vm_end & HPAGE_PMD_MASK;
+	if (address < hstart || address + HPAGE_PMD_SIZE > hend)
+		goto out;
+	if (!khugepaged_vma_check(vma))
+		goto out;
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || !pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		goto out;
+
+	if (unlikely(charge_hugepage(new_page, mm)))
+		goto out;
+
+	mmu_notifier_invalidate_range_start(mm, address,
+					    address + HPAGE_PMD_SIZE);
+	anon_vma_lock(vma->anon_vma);
+
+	/* map the pte table while the pmd still points at it */
+	pte = pte_offset_map(pmd, address);
+	ptl = pte_lockptr(mm, pmd);
+
+	/* after the flush get_user_pages_fast() can't reach the ptes */
+	spin_lock(&mm->page_table_lock);
+	_pmd = pmdp_clear_flush(vma, address, pmd);
+	spin_unlock(&mm->page_table_lock);
+
+	spin_lock(ptl);
+	isolated = __collapse_huge_page_isolate(vma, address, pte);
+	spin_unlock(ptl);
+
+	if (unlikely(!isolated)) {
+		pte_unmap(pte);
+		spin_lock(&mm->page_table_lock);
+		BUG_ON(!pmd_none(*pmd));
+		set_pmd_at(mm, address, pmd, _pmd);
+		spin_unlock(&mm->page_table_lock);
+		anon_vma_unlock(vma->anon_vma);
+		mmu_notifier_invalidate_range_end(mm, address,
+						  address + HPAGE_PMD_SIZE);
+		uncharge_hugepage(new_page, HPAGE_PMD_NR);
+		goto out;
+	}
+
+	/* rmap walkers now find neither the old ptes nor the new pmd */
+	anon_vma_unlock(vma->anon_vma);
+
+	nr_anon = __collapse_huge_page_copy(pte, new_page, vma, address, ptl);
+	pte_unmap(pte);
+	pgtable = pmd_pgtable(_pmd);
+
+	entry = mk_pmd(new_page, vma->vm_page_prot);
+	if (likely(vma->vm_flags & VM_WRITE))
+		entry = pmd_mkwrite(pmd_mkdirty(entry));
+	entry = pmd_mkhuge(entry);
+
+	smp_wmb(); /* make the copies visible before the pmd */
+
+	spin_lock(&mm->page_table_lock);
+	BUG_ON(!pmd_none(*pmd));
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_new_anon_rmap(new_page + i, vma,
+				       address + i * PAGE_SIZE);
+	set_pmd_at(mm, address, pmd, entry);
+	/* the old page table is already accounted in nr_ptes */
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_ANONPAGES, HPAGE_PMD_NR - nr_anon);
+	spin_unlock(&mm->page_table_lock);
+
+	mmu_notifier_invalidate_range_end(mm, address,
+					  address + HPAGE_PMD_SIZE);
+
+	*hpage = NULL;
+	khugepaged_pages_collapsed++;
+out:
+	up_write(&mm->mmap_sem);
+}
+
+/*
+ * Look whether the range mapped by the pmd at @address is worth
+ * collapsing.  Returns 1 if mmap_sem was released in the attempt.
+ */
+static int khugepaged_scan_pmd(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long address,
+			       struct page **hpage)
+{
+	unsigned long _address;
+	struct page *page;
+	pmd_t *pmd;
+	pte_t *pte, *_pte;
+	spinlock_t *ptl;
+	int ret = 0, none = 0;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || !pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return 0;
+
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	for (_address = address, _pte = pte; _pte < pte+HPAGE_PMD_NR;
+	     _pte++, _address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+
+		if (pte_none(pteval)) {
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out_unmap;
+		}
+		if (!pte_present(pteval))
+			goto out_unmap;
+		page = vm_normal_page(vma, _address, pteval);
+		if (!page) {	/* the zero page */
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out_unmap;
+		}
+		if (!PageLRU(page) || PageLocked(page) || !PageAnon(page) ||
+		    PageKsm(page) || PageSwapCache(page))
+			goto out_unmap;
+		if (page_count(page) != 1)
+			goto out_unmap;
+	}
+	ret = 1;
+out_unmap:
+	pte_unmap_unlock(pte, ptl);
+	if (ret)
+		collapse_huge_page(mm, address, hpage);
+	return ret;
+}
+
+static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
+					    struct page **hpage)
+{
+	struct mm_slot *mm_slot;
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	unsigned int progress = 0;
+	int free = 0;
+
+	spin_lock(&khugepaged_mm_lock);
+	if (khugepaged_scan.mm_slot)
+		mm_slot = khugepaged_scan.mm_slot;
+	else {
+		if (list_empty(&khugepaged_scan.mm_head)) {
+			spin_unlock(&khugepaged_mm_lock);
+			return pages;
+		}
+		mm_slot = list_entry(khugepaged_scan.mm_head.next,
+				     struct mm_slot, mm_node);
+		khugepaged_scan.address = 0;
+		khugepaged_scan.mm_slot = mm_slot;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	mm = mm_slot->mm;
+	down_read(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		vma = NULL;
+	else
+		vma = find_vma(mm, khugepaged_scan.address);
+
+	progress++;
+	for (; vma; vma = vma->vm_next) {
+		unsigned long hstart, hend;
+
+		cond_resched();
+		if (unlikely(khugepaged_test_exit(mm))) {
+			progress++;
+			break;
+		}
+		progress++;
+		if (!khugepaged_vma_check(vma))
+			continue;
+		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+		hend = vma->vm_end & HPAGE_PMD_MASK;
+		if (hstart >= hend || khugepaged_scan.address >= hend)
+			continue;
+		if (khugepaged_scan.address < hstart)
+			khugepaged_scan.address = hstart;
+
+		while (khugepaged_scan.address < hend) {
+			int ret;
+
+			cond_resched();
+			if (unlikely(khugepaged_test_exit(mm)))
+				goto breakouterloop;
+
+			ret = khugepaged_scan_pmd(mm, vma,
+						  khugepaged_scan.address,
+						  hpage);
+			khugepaged_scan.address += HPAGE_PMD_SIZE;
+			progress += HPAGE_PMD_NR;
+			if (ret)
+				/* mmap_sem was released, vma is stale */
+				goto breakouterloop_mmap_sem;
+			if (progress >= pages)
+				goto breakouterloop;
+		}
+	}
+breakouterloop:
+	up_read(&mm->mmap_sem); /* exit_mmap will destroy ptes after this */
+breakouterloop_mmap_sem:
+
+	spin_lock(&khugepaged_mm_lock);
+	VM_BUG_ON(khugepaged_scan.mm_slot != mm_slot);
+	/*
+	 * Move on to the next mm when done with this one, freeing its
+	 * mm_slot if it is exiting: __khugepaged_exit() left it to us.
+	 */
+	if (khugepaged_test_exit(mm) || !vma) {
+		if (mm_slot->mm_node.next != &khugepaged_scan.mm_head) {
+			khugepaged_scan.mm_slot = list_entry(
+				mm_slot->mm_node.next,
+				struct mm_slot, mm_node);
+			khugepaged_scan.address = 0;
+		} else {
+			khugepaged_scan.mm_slot = NULL;
+			khugepaged_full_scans++;
+		}
+		if (khugepaged_test_exit(mm)) {
+			hlist_del(&mm_slot->hash);
+			list_del(&mm_slot->mm_node);
+			free = 1;
+		}
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (free) {
+		clear_bit(MMF_VM_HUGEPAGE, &mm->flags);
+		free_mm_slot(mm_slot);
+		mmdrop(mm);
+	}
+
+	return progress;
+}
+
+static int khugepaged_should_run(void)
+{
+	return khugepaged_enabled() && !list_empty(&khugepaged_scan.mm_head);
+}
+
+static void khugepaged_do_scan(void)
+{
+	struct page *hpage = NULL;
+	unsigned int progress = 0, pass_through_head = 0;
+	unsigned int pages = khugepaged_pages_to_scan;
+
+	while (progress < pages) {
+		cond_resched();
+		if (unlikely(kthread_should_stop()))
+			break;
+
+		/* khugepaged is the only one moving the cursor */
+		if (!khugepaged_scan.mm_slot)
+			pass_through_head++;
+		if (khugepaged_should_run() && pass_through_head < 2)
+			progress += khugepaged_scan_mm_slot(pages - progress,
+							    &hpage);
+		else
+			progress = pages;
+
+		if (IS_ERR(hpage)) {
+			/* fragmented: give the allocator some time */
+			hpage = NULL;
+			schedule_timeout_interruptible(
+			    msecs_to_jiffies(khugepaged_alloc_sleep_millisecs));
+			break;
+		}
+	}
+
+	if (hpage)
+		free_hugepage(hpage);
+}
+
+static int khugepaged(void *none)
+{
+	set_user_nice(current, 19);
+
+	while (!kthread_should_stop()) {
+		if (khugepaged_should_run())
+			khugepaged_do_scan();
+
+		if (khugepaged_should_run()) {
+			schedule_timeout_interruptible(
+			    msecs_to_jiffies(khugepaged_scan_sleep_millisecs));
+		} else {
+			wait_event_interruptible(khugepaged_wait,
+				khugepaged_should_run() ||
+				kthread_should_stop());
+		}
+	}
+	return 0;
+}
+
+#ifdef CONFIG_SYSFS
+#define THP_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define THP_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	if (test_bit(TRANSPARENT_HUGEPAGE_FLAG, &transparent_hugepage_flags))
+		return sprintf(buf, "[always] madvise never\n");
+	if (test_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+		     &transparent_hugepage_flags))
+		return sprintf(buf, "always [madvise] never\n");
+	return sprintf(buf, "always madvise [never]\n");
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	if (sysfs_streq(buf, "always")) {
+		set_bit(TRANSPARENT_HUGEPAGE_FLAG, &transparent_hugepage_flags);
+		clear_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			  &transparent_hugepage_flags);
+	} else if (sysfs_streq(buf, "madvise")) {
+		clear_bit(TRANSPARENT_HUGEPAGE_FLAG,
+			  &transparent_hugepage_flags);
+		set_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			&transparent_hugepage_flags);
+	} else if (sysfs_streq(buf, "never")) {
+		clear_bit(TRANSPARENT_HUGEPAGE_FLAG,
+			  &transparent_hugepage_flags);
+		clear_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			  &transparent_hugepage_flags);
+	} else
+		return -EINVAL;
+
+	if (khugepaged_enabled())
+		wake_up_interruptible(&khugepaged_wait);
+
+	return count;
+}
+THP_ATTR(enabled);
+
+static struct attribute *hugepage_attrs[] = {
+	&enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group hugepage_attr_group = {
+	.attrs = hugepage_attrs,
+};
+
+static ssize_t scan_sleep_millisecs_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_scan_sleep_millisecs);
+}
+
+static ssize_t scan_sleep_millisecs_store(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	khugepaged_scan_sleep_millisecs = msecs;
+	wake_up_interruptible(&khugepaged_wait);
+
+	return count;
+}
+THP_ATTR(scan_sleep_millisecs);
+
+static ssize_t alloc_sleep_millisecs_show(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_alloc_sleep_millisecs);
+}
+
+static ssize_t alloc_sleep_millisecs_store(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	khugepaged_alloc_sleep_millisecs = msecs;
+	wake_up_interruptible(&khugepaged_wait);
+
+	return count;
+}
+THP_ATTR(alloc_sleep_millisecs);
+
+static ssize_t pages_to_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_pages_to_scan);
+}
+
+static ssize_t pages_to_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned long pages;
+	int err;
+
+	err = strict_strtoul(buf, 10, &pages);
+	if (err || !pages || pages > UINT_MAX)
+		return -EINVAL;
+
+	khugepaged_pages_to_scan = pages;
+
+	return count;
+}
+THP_ATTR(pages_to_scan);
+
+static ssize_t max_ptes_none_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_max_ptes_none);
+}
+
+static ssize_t max_ptes_none_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned long max_ptes_none;
+	int err;
+
+	err = strict_strtoul(buf, 10, &max_ptes_none);
+	if (err || max_ptes_none > HPAGE_PMD_NR-1)
+		return -EINVAL;
+
+	khugepaged_max_ptes_none = max_ptes_none;
+
+	return count;
+}
+THP_ATTR(max_ptes_none);
+
+static ssize_t pages_collapsed_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_pages_collapsed);
+}
+THP_ATTR_RO(pages_collapsed);
+
+static ssize_t full_scans_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_full_scans);
+}
+THP_ATTR_RO(full_scans);
+
+static struct attribute *khugepaged_attrs[] = {
+	&scan_sleep_millisecs_attr.attr,
+	&alloc_sleep_millisecs_attr.attr,
+	&pages_to_scan_attr.attr,
+	&max_ptes_none_attr.attr,
+	&pages_collapsed_attr.attr,
+	&full_scans_attr.attr,
+	NULL,
+};
+
+static struct attribute_group khugepaged_attr_group = {
+	.attrs = khugepaged_attrs,
+	.name = "khugepaged",
+};
+
+static int __init hugepage_init_sysfs(void)
+{
+	struct kobject *hugepage_kobj;
+	int err;
+
+	hugepage_kobj = kobject_create_and_add("transparent_hugepage",
+					       mm_kobj);
+	if (!hugepage_kobj)
+		return -ENOMEM;
+
+	err = sysfs_create_group(hugepage_kobj, &hugepage_attr_group);
+	if (err)
+		goto out_put;
+
+	err = sysfs_create_group(hugepage_kobj, &khugepaged_attr_group);
+	if (err)
+		goto out_remove;
+
+	return 0;
+
+out_remove:
+	sysfs_remove_group(hugepage_kobj, &hugepage_attr_group);
+out_put:
+	kobject_put(hugepage_kobj);
+	return err;
+}
+#endif /* CONFIG_SYSFS */
+
+static int __init hugepage_init(void)
+{
+	struct task_struct *khugepaged_thread;
+	int err;
+
+	/*
+	 * On small machines the memory footprint of huge pages is not
+	 * worth the TLB gains: leave it to the admin to enable them.
+	 */
+	if (totalram_pages < (512 << (20 - PAGE_SHIFT)))
+		transparent_hugepage_flags = 0;
+
+	mm_slot_cache = kmem_cache_create("khugepaged_mm_slot",
+					  sizeof(struct mm_slot),
+					  __alignof__(struct mm_slot), 0, NULL);
+	if (!mm_slot_cache)
+		return -ENOMEM;
+
+	khugepaged_thread = kthread_run(khugepaged, NULL, "khugepaged");
+	if (IS_ERR(khugepaged_thread)) {
+		printk(KERN_ERR "hugepage: creating khugepaged failed\n");
+		err = PTR_ERR(khugepaged_thread);
+		goto out_free;
+	}
+
+#ifdef CONFIG_SYSFS
+	err = hugepage_init_sysfs();
+	if (err) {
+		printk(KERN_ERR "hugepage: register sysfs failed\n");
+		kthread_stop(khugepaged_thread);
+		goto out_free;
+	}
+#endif
+	return 0;
+
+out_free:
+	kmem_cache_destroy(mm_slot_cache);
+	mm_slot_cache = NULL;
+	return err;
+}
+module_init(hugepage_init)
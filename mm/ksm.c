@@ -84,28 +84,36 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @busy: set while a ksmd thread owns this mm_slot and its rmap_list
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	int busy;
 };
 
 /**
  * struct ksm_scan - cursor for scanning
- * @mm_slot: the current mm_slot we are scanning
+ * @mm_slot: the mm_slot this thread is scanning, or NULL between mm_slots
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
- * @seqnr: count of completed full scans (needed when removing unstable node)
+ * @stale: rmap_items unlinked from the rmap_list, to be removed from the trees
+ * @pages_scanned: pages this thread has compared against the trees
+ * @pages_skipped: volatile pages this thread has passed over
  *
- * There is only the one ksm_scan instance of this cursor structure.
+ * Each ksmd thread has its own cursor: mm_slots are handed out one at a
+ * time from ksm_scan_next, and the thread owning an mm_slot is the only
+ * one to walk or modify its rmap_list.
  */
 struct ksm_scan {
 	struct mm_slot *mm_slot;
 	unsigned long address;
 	struct rmap_item **rmap_list;
-	unsigned long seqnr;
+	struct rmap_item *stale;
+	unsigned long pages_scanned;
+	unsigned long pages_skipped;
 };
 
 /**
@@ -127,6 +135,8 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @volatility: number of consecutive scans which found the checksum changed
+ * @skip_rounds: number of scans still to pass over this volatile page
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -137,6 +147,8 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	unsigned short volatility;	/* fit in the padding after */
+	unsigned short skip_rounds;	/* oldchecksum on 64-bit */
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -161,10 +173,32 @@ static struct hlist_head mm_slots_hash[MM_SLOTS_HASH_HEADS];
 static struct mm_slot ksm_mm_head = {
 	.mm_list = LIST_HEAD_INIT(ksm_mm_head.mm_list),
 };
-static struct ksm_scan ksm_scan = {
-	.mm_slot = &ksm_mm_head,
+
+/*
+ * The next mm_slot to be handed out to a ksmd thread in this pass,
+ * or ksm_mm_head once they all have been: protected by ksm_mmlist_lock.
+ */
+static struct mm_slot *ksm_scan_next = &ksm_mm_head;
+
+/* Number of mm_slots currently owned by ksmd threads: ksm_mmlist_lock */
+static unsigned int ksm_scan_busy;
+
+/* Count of completed full scans (needed when removing unstable node) */
+static unsigned long ksm_scan_seqnr;
+
+/**
+ * struct ksm_thread - a ksmd scanning thread
+ * @task: the kthread, or NULL when this slot is not running
+ * @scan: this thread's scanning cursor
+ */
+struct ksm_thread {
+	struct task_struct *task;
+	struct ksm_scan scan;
 };
 
+#define KSM_MAX_THREADS	16
+static struct ksm_thread ksm_threads[KSM_MAX_THREADS];
+
 static struct kmem_cache *rmap_item_cache;
 static struct kmem_cache *stable_node_cache;
 static struct kmem_cache *mm_slot_cache;
@@ -179,7 +213,7 @@ static unsigned long ksm_pages_sharing;
 static unsigned long ksm_pages_unshared;
 
 /* The number of rmap_items in use: to calculate pages_volatile */
-static unsigned long ksm_rmap_items;
+static atomic_long_t ksm_rmap_items = ATOMIC_LONG_INIT(0);
 
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
@@ -187,13 +221,33 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Number of ksmd threads scanning in parallel */
+static unsigned int ksm_nr_threads = 1;
+
+/*
+ * Upper limit on the number of full scans for which a page whose checksum
+ * keeps changing is passed over: the skip doubles with each consecutive
+ * change, and is reset once the page is found unchanged.  0 disables.
+ */
+static unsigned int ksm_max_skip_rounds = 8;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
 static unsigned int ksm_run = KSM_RUN_STOP;
 
+/*
+ * ksmd threads hold ksm_thread_sem for read while scanning a batch:
+ * it is taken for write to lock them all out (unmerging, memory hotremove).
+ * ksm_tree_lock serializes the threads on the stable and unstable trees,
+ * the tree flags of rmap_items, and the pages_shared/sharing/unshared
+ * counts; it nests outside mmap_sem and page lock, so rmap_items may only
+ * be removed from the trees when the scanner has dropped its mmap_sem.
+ */
 static DECLARE_WAIT_QUEUE_HEAD(ksm_thread_wait);
-static DEFINE_MUTEX(ksm_thread_mutex);
+static DECLARE_RWSEM(ksm_thread_sem);
+static DEFINE_MUTEX(ksm_tree_lock);
+static DEFINE_MUTEX(ksm_threads_mutex);	/* starting and stopping threads */
 static DEFINE_SPINLOCK(ksm_mmlist_lock);
 
 #define KSM_KMEM_CACHE(__struct, __flags) kmem_cache_create("ksm_"#__struct,\
@@ -238,13 +292,14 @@ static inline struct rmap_item *alloc_rmap_item(void)
 
 	rmap_item = kmem_cache_zalloc(rmap_item_cache, GFP_KERNEL);
 	if (rmap_item)
-		ksm_rmap_items++;
+		atomic_long_inc(&ksm_rmap_items);
 	return rmap_item;
 }
 
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
-	ksm_rmap_items--;
+	atomic_long_dec(&ksm_rmap_items);
+	rmap_item->mm->ksm_rmap_items--;
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -451,6 +506,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 		ksm_drop_anon_vma(rmap_item);
 		rmap_item->address &= PAGE_MASK;
 		cond_resched();
@@ -478,7 +534,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
  * a page to put something that might look like our key in page->mapping.
  *
  * include/linux/pagemap.h page_cache_get_speculative() is a good reference,
- * but this is different - made simpler by ksm_thread_mutex being held, but
+ * but this is different - made simpler by ksm_tree_lock being held, but
  * interesting for assuming that no other use of the struct page could ever
  * put our expected_mapping into page->mapping (or a field of the union which
  * coincides with page->mapping).  The RCU calls are not for KSM at all, but
@@ -517,6 +573,7 @@ stale:
 /*
  * Removing rmap_item from stable or unstable tree.
  * This function will clean the information from the stable/unstable tree.
+ * Called with ksm_tree_lock held.
  */
 static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 {
@@ -538,6 +595,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 
 		ksm_drop_anon_vma(rmap_item);
 		rmap_item->address &= PAGE_MASK;
@@ -551,7 +609,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		 * if this rmap_item was inserted by this scan, rather
 		 * than left over from before.
 		 */
-		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
+		age = (unsigned char)(ksm_scan_seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
 			rb_erase(&rmap_item->node, &root_unstable_tree);
@@ -563,14 +621,50 @@ out:
 	cond_resched();		/* we're called from many long loops */
 }
 
-static void remove_trailing_rmap_items(struct mm_slot *mm_slot,
-				       struct rmap_item **rmap_list)
+/*
+ * Remove and free a list of rmap_items already unlinked from their rmap_list.
+ * This must not be called with mmap_sem held: ksm_tree_lock nests outside it.
+ */
+static void free_stale_rmap_items(struct rmap_item *rmap_item)
+{
+	while (rmap_item) {
+		struct rmap_item *next = rmap_item->rmap_list;
+
+		mutex_lock(&ksm_tree_lock);
+		remove_rmap_item_from_tree(rmap_item);
+		mutex_unlock(&ksm_tree_lock);
+		free_rmap_item(rmap_item);
+		rmap_item = next;
+	}
+}
+
+/*
+ * Take the rmap_items from @rmap_item onwards, which this pass has not yet
+ * reached, out of the unstable tree.  Needed when a ksmd thread exits part
+ * way through an mm_slot: the pass has already moved beyond that mm_slot,
+ * so they would not be visited again until the pass after next.
+ */
+static void forget_unscanned_rmap_items(struct rmap_item *rmap_item)
+{
+	mutex_lock(&ksm_tree_lock);
+	for (; rmap_item; rmap_item = rmap_item->rmap_list)
+		if (rmap_item->address & UNSTABLE_FLAG)
+			remove_rmap_item_from_tree(rmap_item);
+	mutex_unlock(&ksm_tree_lock);
+}
+
+/*
+ * Unlink all the rmap_items from *rmap_list onwards, adding them to the
+ * stale list, for free_stale_rmap_items() once mmap_sem has been dropped.
+ */
+static void remove_trailing_rmap_items(struct rmap_item **rmap_list,
+				       struct rmap_item **stale)
 {
 	while (*rmap_list) {
 		struct rmap_item *rmap_item = *rmap_list;
 		*rmap_list = rmap_item->rmap_list;
-		remove_rmap_item_from_tree(rmap_item);
-		free_rmap_item(rmap_item);
+		rmap_item->rmap_list = *stale;
+		*stale = rmap_item;
 	}
 }
 
@@ -613,15 +707,30 @@ static int unmerge_and_remove_all_rmap_items(void)
 	struct mm_slot *mm_slot;
 	struct mm_struct *mm;
 	struct vm_area_struct *vma;
+	struct rmap_item *stale;
 	int err = 0;
+	int i;
 
+	/*
+	 * With ksm_thread_sem held for write, no ksmd thread is scanning:
+	 * forget their cursors, which point into rmap_lists about to be freed.
+	 */
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
+	for (i = 0; i < KSM_MAX_THREADS; i++) {
+		struct ksm_scan *scan = &ksm_threads[i].scan;
+
+		if (scan->mm_slot) {
+			scan->mm_slot->busy = 0;
+			scan->mm_slot = NULL;
+		}
+	}
+	ksm_scan_busy = 0;
+	ksm_scan_next = list_entry(ksm_mm_head.mm_list.next,
 						struct mm_slot, mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
-	for (mm_slot = ksm_scan.mm_slot;
-			mm_slot != &ksm_mm_head; mm_slot = ksm_scan.mm_slot) {
+	for (mm_slot = ksm_scan_next;
+			mm_slot != &ksm_mm_head; mm_slot = ksm_scan_next) {
 		mm = mm_slot->mm;
 		down_read(&mm->mmap_sem);
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
@@ -635,10 +744,11 @@ static int unmerge_and_remove_all_rmap_items(void)
 				goto error;
 		}
 
-		remove_trailing_rmap_items(mm_slot, &mm_slot->rmap_list);
+		stale = NULL;
+		remove_trailing_rmap_items(&mm_slot->rmap_list, &stale);
 
 		spin_lock(&ksm_mmlist_lock);
-		ksm_scan.mm_slot = list_entry(mm_slot->mm_list.next,
+		ksm_scan_next = list_entry(mm_slot->mm_list.next,
 						struct mm_slot, mm_list);
 		if (ksm_test_exit(mm)) {
 			hlist_del(&mm_slot->link);
@@ -648,20 +758,22 @@ static int unmerge_and_remove_all_rmap_items(void)
 			free_mm_slot(mm_slot);
 			clear_bit(MMF_VM_MERGEABLE, &mm->flags);
 			up_read(&mm->mmap_sem);
+			free_stale_rmap_items(stale);
 			mmdrop(mm);
 		} else {
 			spin_unlock(&ksm_mmlist_lock);
 			up_read(&mm->mmap_sem);
+			free_stale_rmap_items(stale);
 		}
 	}
 
-	ksm_scan.seqnr = 0;
+	ksm_scan_seqnr = 0;
 	return 0;
 
 error:
 	up_read(&mm->mmap_sem);
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = &ksm_mm_head;
+	ksm_scan_next = &ksm_mm_head;
 	spin_unlock(&ksm_mmlist_lock);
 	return err;
 }
@@ -1096,7 +1208,7 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 	}
 
 	rmap_item->address |= UNSTABLE_FLAG;
-	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
+	rmap_item->address |= (ksm_scan_seqnr & SEQNR_MASK);
 	rb_link_node(&rmap_item->node, parent, new);
 	rb_insert_color(&rmap_item->node, &root_unstable_tree);
 
@@ -1120,6 +1232,23 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+	rmap_item->mm->ksm_merging_pages++;
+}
+
+/*
+ * The checksum of the page at rmap_item has changed again since the last
+ * scan: pass over it for a number of scans which doubles with each
+ * consecutive change, up to ksm_max_skip_rounds.  The first change seen
+ * does not count: a new rmap_item starts out with no checksum at all.
+ */
+static void rmap_item_changed(struct rmap_item *rmap_item)
+{
+	unsigned int skip;
+
+	if (rmap_item->volatility < 16)
+		rmap_item->volatility++;
+	skip = (1U << rmap_item->volatility) >> 2;
+	rmap_item->skip_rounds = min(skip, ksm_max_skip_rounds);
 }
 
 /*
@@ -1128,6 +1257,10 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  * be inserted into the unstable tree, or merged with a page already there and
  * both transferred to the stable tree.
  *
+ * The checksum is calculated before taking ksm_tree_lock, so that ksmd
+ * threads can hash in parallel, even though the page may then turn out
+ * to match the stable tree and not need it.
+ *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
  */
@@ -1140,6 +1273,9 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	unsigned int checksum;
 	int err;
 
+	checksum = calc_checksum(page);
+
+	mutex_lock(&ksm_tree_lock);
 	remove_rmap_item_from_tree(rmap_item);
 
 	/* We first start with searching the page inside the stable tree */
@@ -1156,7 +1292,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			unlock_page(kpage);
 		}
 		put_page(kpage);
-		return;
+		goto out;
 	}
 
 	/*
@@ -1165,11 +1301,12 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
-		return;
+		rmap_item_changed(rmap_item);
+		goto out;
 	}
+	rmap_item->volatility = 0;
 
 	tree_rmap_item =
 		unstable_tree_search_insert(rmap_item, page, &tree_page);
@@ -1205,11 +1342,14 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			}
 		}
 	}
+out:
+	mutex_unlock(&ksm_tree_lock);
 }
 
 static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 					    struct rmap_item **rmap_list,
-					    unsigned long addr)
+					    unsigned long addr,
+					    struct rmap_item **stale)
 {
 	struct rmap_item *rmap_item;
 
@@ -1220,8 +1360,8 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 		if (rmap_item->address > addr)
 			break;
 		*rmap_list = rmap_item->rmap_list;
-		remove_rmap_item_from_tree(rmap_item);
-		free_rmap_item(rmap_item);
+		rmap_item->rmap_list = *stale;
+		*stale = rmap_item;
 	}
 
 	rmap_item = alloc_rmap_item();
@@ -1231,11 +1371,67 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 		rmap_item->address = addr;
 		rmap_item->rmap_list = *rmap_list;
 		*rmap_list = rmap_item;
+		mm_slot->mm->ksm_rmap_items++;
 	}
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * Hand out the next mm_slot of this pass to a ksmd thread.  A new pass,
+ * with a new unstable tree, can only begin once every mm_slot of the last
+ * pass has been handed back: until then, return NULL.
+ */
+static struct mm_slot *ksm_claim_mm_slot(struct ksm_scan *scan)
+{
+	struct mm_slot *slot;
+
+	spin_lock(&ksm_mmlist_lock);
+	if (ksm_scan_next == &ksm_mm_head) {
+		if (ksm_scan_busy) {
+			spin_unlock(&ksm_mmlist_lock);
+			return NULL;
+		}
+		root_unstable_tree = RB_ROOT;
+		ksm_scan_next = list_entry(ksm_mm_head.mm_list.next,
+						struct mm_slot, mm_list);
+		if (ksm_scan_next == &ksm_mm_head) {
+			spin_unlock(&ksm_mmlist_lock);
+			return NULL;
+		}
+	}
+	slot = ksm_scan_next;
+	ksm_scan_next = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
+	slot->busy = 1;
+	ksm_scan_busy++;
+	scan->mm_slot = slot;
+	spin_unlock(&ksm_mmlist_lock);
+
+	return slot;
+}
+
+/*
+ * Hand back the mm_slot this thread has been scanning (NULL if it has just
+ * been freed): returns 1 if that completed a full scan of all mm_slots.
+ */
+static int ksm_release_mm_slot(struct ksm_scan *scan, struct mm_slot *slot)
+{
+	int full_scan = 0;
+
+	spin_lock(&ksm_mmlist_lock);
+	if (slot)
+		slot->busy = 0;
+	scan->mm_slot = NULL;
+	if (!--ksm_scan_busy && ksm_scan_next == &ksm_mm_head) {
+		ksm_scan_seqnr++;
+		full_scan = 1;
+	}
+	spin_unlock(&ksm_mmlist_lock);
+
+	return full_scan;
+}
+
+static struct rmap_item *scan_get_next_rmap_item(struct ksm_scan *scan,
+						 struct page **page)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
@@ -1245,17 +1441,14 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 	if (list_empty(&ksm_mm_head.mm_list))
 		return NULL;
 
-	slot = ksm_scan.mm_slot;
-	if (slot == &ksm_mm_head) {
-		root_unstable_tree = RB_ROOT;
-
-		spin_lock(&ksm_mmlist_lock);
-		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
-		ksm_scan.mm_slot = slot;
-		spin_unlock(&ksm_mmlist_lock);
+	slot = scan->mm_slot;
+	if (!slot) {
 next_mm:
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		slot = ksm_claim_mm_slot(scan);
+		if (!slot)
+			return NULL;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 
 	mm = slot->mm;
@@ -1263,55 +1456,55 @@ next_mm:
 	if (ksm_test_exit(mm))
 		vma = NULL;
 	else
-		vma = find_vma(mm, ksm_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	for (; vma; vma = vma->vm_next) {
 		if (!(vma->vm_flags & VM_MERGEABLE))
 			continue;
-		if (ksm_scan.address < vma->vm_start)
-			ksm_scan.address = vma->vm_start;
+		if (scan->address < vma->vm_start)
+			scan->address = vma->vm_start;
 		if (!vma->anon_vma)
-			ksm_scan.address = vma->vm_end;
+			scan->address = vma->vm_end;
 
-		while (ksm_scan.address < vma->vm_end) {
+		while (scan->address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			*page = follow_page(vma, scan->address, FOLL_GET);
 			if (!IS_ERR_OR_NULL(*page) && PageAnon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
+				flush_anon_page(vma, *page, scan->address);
 				flush_dcache_page(*page);
 				rmap_item = get_next_rmap_item(slot,
-					ksm_scan.rmap_list, ksm_scan.address);
+					scan->rmap_list, scan->address,
+					&scan->stale);
 				if (rmap_item) {
-					ksm_scan.rmap_list =
+					scan->rmap_list =
 							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
+					scan->address += PAGE_SIZE;
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
+				free_stale_rmap_items(scan->stale);
+				scan->stale = NULL;
 				return rmap_item;
 			}
 			if (!IS_ERR_OR_NULL(*page))
 				put_page(*page);
-			ksm_scan.address += PAGE_SIZE;
+			scan->address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
 	if (ksm_test_exit(mm)) {
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
 	 */
-	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	remove_trailing_rmap_items(scan->rmap_list, &scan->stale);
 
-	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
-						struct mm_slot, mm_list);
-	if (ksm_scan.address == 0) {
+	if (scan->address == 0) {
 		/*
 		 * We've completed a full scan of all vmas, holding mmap_sem
 		 * throughout, and found no VM_MERGEABLE: so do the same as
@@ -1320,7 +1513,10 @@ next_mm:
 		 * (but beware: we can reach here even before __ksm_exit),
 		 * or when all VM_MERGEABLE areas have been unmapped (and
 		 * mmap_sem then protects against race with MADV_MERGEABLE).
+		 * The mm itself is only dropped once its stale rmap_items
+		 * have been removed from the trees.
 		 */
+		spin_lock(&ksm_mmlist_lock);
 		hlist_del(&slot->link);
 		list_del(&slot->mm_list);
 		spin_unlock(&ksm_mmlist_lock);
@@ -1328,37 +1524,50 @@ next_mm:
 		free_mm_slot(slot);
 		clear_bit(MMF_VM_MERGEABLE, &mm->flags);
 		up_read(&mm->mmap_sem);
+		free_stale_rmap_items(scan->stale);
+		scan->stale = NULL;
 		mmdrop(mm);
+		slot = NULL;
 	} else {
-		spin_unlock(&ksm_mmlist_lock);
 		up_read(&mm->mmap_sem);
+		free_stale_rmap_items(scan->stale);
+		scan->stale = NULL;
 	}
 
 	/* Repeat until we've completed scanning the whole list */
-	slot = ksm_scan.mm_slot;
-	if (slot != &ksm_mm_head)
+	if (!ksm_release_mm_slot(scan, slot))
 		goto next_mm;
 
-	ksm_scan.seqnr++;
 	return NULL;
 }
 
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
+ * @scan - the cursor of the ksmd thread doing the scanning.
  * @scan_npages - number of pages we want to scan before we return.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static void ksm_do_scan(struct ksm_scan *scan, unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
 
 	while (scan_npages--) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
+		rmap_item = scan_get_next_rmap_item(scan, &page);
 		if (!rmap_item)
 			return;
-		if (!PageKsm(page) || !in_stable_tree(rmap_item))
-			cmp_and_merge_page(page, rmap_item);
+		if (!PageKsm(page) || !in_stable_tree(rmap_item)) {
+			if (rmap_item->skip_rounds) {
+				/* Volatile page: don't waste effort on it */
+				rmap_item->skip_rounds--;
+				rmap_item->mm->ksm_pages_skipped++;
+				scan->pages_skipped++;
+			} else {
+				cmp_and_merge_page(page, rmap_item);
+				rmap_item->mm->ksm_pages_scanned++;
+				scan->pages_scanned++;
+			}
+		}
 		put_page(page);
 	}
 }
@@ -1368,15 +1577,17 @@ static int ksmd_should_run(void)
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
 }
 
-static int ksm_scan_thread(void *nothing)
+static int ksm_scan_thread(void *data)
 {
+	struct ksm_scan *scan = data;
+
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
-		mutex_lock(&ksm_thread_mutex);
+		down_read(&ksm_thread_sem);
 		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
-		mutex_unlock(&ksm_thread_mutex);
+			ksm_do_scan(scan, ksm_thread_pages_to_scan);
+		up_read(&ksm_thread_sem);
 
 		if (ksmd_should_run()) {
 			schedule_timeout_interruptible(
@@ -1386,9 +1597,45 @@ static int ksm_scan_thread(void *nothing)
 				ksmd_should_run() || kthread_should_stop());
 		}
 	}
+
+	/* Hand back any mm_slot we were part way through scanning */
+	down_read(&ksm_thread_sem);
+	if (scan->mm_slot) {
+		forget_unscanned_rmap_items(*scan->rmap_list);
+		ksm_release_mm_slot(scan, scan->mm_slot);
+	}
+	up_read(&ksm_thread_sem);
 	return 0;
 }
 
+static int ksm_start_thread(int nr)
+{
+	struct ksm_thread *thread = &ksm_threads[nr];
+	struct task_struct *task;
+
+	if (nr)
+		task = kthread_run(ksm_scan_thread, &thread->scan,
+				   "ksmd/%d", nr);
+	else
+		task = kthread_run(ksm_scan_thread, &thread->scan, "ksmd");
+	if (IS_ERR(task)) {
+		printk(KERN_ERR "ksm: creating kthread failed\n");
+		return PTR_ERR(task);
+	}
+	thread->task = task;
+	return 0;
+}
+
+static void ksm_stop_thread(int nr)
+{
+	struct ksm_thread *thread = &ksm_threads[nr];
+
+	if (thread->task) {
+		kthread_stop(thread->task);
+		thread->task = NULL;
+	}
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -1451,7 +1698,7 @@ int __ksm_enter(struct mm_struct *mm)
 	 * down a little; when fork is followed by immediate exec, we don't
 	 * want ksmd to waste time setting up and tearing down an rmap_list.
 	 */
-	list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+	list_add_tail(&mm_slot->mm_list, &ksm_scan_next->mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
@@ -1471,22 +1718,23 @@ void __ksm_exit(struct mm_struct *mm)
 	/*
 	 * This process is exiting: if it's straightforward (as is the
 	 * case when ksmd was never running), free mm_slot immediately.
-	 * But if it's at the cursor or has rmap_items linked to it, use
-	 * mmap_sem to synchronize with any break_cows before pagetables
-	 * are freed, and leave the mm_slot on the list for ksmd to free.
+	 * But if it's at the cursor, being scanned, or has rmap_items linked
+	 * to it, use mmap_sem to synchronize with any break_cows before
+	 * pagetables are freed, and leave the mm_slot on the list for ksmd
+	 * to free.
 	 * Beware: ksm may already have noticed it exiting and freed the slot.
 	 */
 
 	spin_lock(&ksm_mmlist_lock);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && ksm_scan.mm_slot != mm_slot) {
+	if (mm_slot && ksm_scan_next != mm_slot && !mm_slot->busy) {
 		if (!mm_slot->rmap_list) {
 			hlist_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
 			easy_to_free = 1;
 		} else {
 			list_move(&mm_slot->mm_list,
-				  &ksm_scan.mm_slot->mm_list);
+				  &ksm_scan_next->mm_list);
 		}
 	}
 	spin_unlock(&ksm_mmlist_lock);
@@ -1725,7 +1973,7 @@ static int ksm_memory_callback(struct notifier_block *self,
 		 * Keep it very simple for now: just lock out ksmd and
 		 * MADV_UNMERGEABLE while any memory is going offline.
 		 */
-		mutex_lock(&ksm_thread_mutex);
+		down_write(&ksm_thread_sem);
 		break;
 
 	case MEM_OFFLINE:
@@ -1734,13 +1982,15 @@ static int ksm_memory_callback(struct notifier_block *self,
 		 * be a few stable_nodes left over, still pointing to struct
 		 * pages which have been offlined: prune those from the tree.
 		 */
+		mutex_lock(&ksm_tree_lock);
 		while ((stable_node = ksm_check_stable_tree(mn->start_pfn,
 					mn->start_pfn + mn->nr_pages)) != NULL)
 			remove_node_from_stable_tree(stable_node);
+		mutex_unlock(&ksm_tree_lock);
 		/* fallthrough */
 
 	case MEM_CANCEL_OFFLINE:
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 		break;
 	}
 	return NOTIFY_OK;
@@ -1829,7 +2079,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 	 * on the list for when ksmd may be set running again).
 	 */
 
-	mutex_lock(&ksm_thread_mutex);
+	down_write(&ksm_thread_sem);
 	if (ksm_run != flags) {
 		ksm_run = flags;
 		if (flags & KSM_RUN_UNMERGE) {
@@ -1842,7 +2092,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 			}
 		}
 	}
-	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_thread_sem);
 
 	if (flags & KSM_RUN_MERGE)
 		wake_up_interruptible(&ksm_thread_wait);
@@ -1851,6 +2101,65 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 }
 KSM_ATTR(run);
 
+static ssize_t nr_threads_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_nr_threads);
+}
+
+static ssize_t nr_threads_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	unsigned long nr_threads;
+	int err;
+	int i;
+
+	err = strict_strtoul(buf, 10, &nr_threads);
+	if (err || nr_threads < 1 || nr_threads > KSM_MAX_THREADS)
+		return -EINVAL;
+
+	mutex_lock(&ksm_threads_mutex);
+	for (i = ksm_nr_threads; i < nr_threads; i++) {
+		err = ksm_start_thread(i);
+		if (err) {
+			nr_threads = i;
+			count = err;
+			break;
+		}
+	}
+	for (i = nr_threads; i < ksm_nr_threads; i++)
+		ksm_stop_thread(i);
+	ksm_nr_threads = nr_threads;
+	mutex_unlock(&ksm_threads_mutex);
+
+	return count;
+}
+KSM_ATTR(nr_threads);
+
+static ssize_t max_skip_rounds_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_skip_rounds);
+}
+
+static ssize_t max_skip_rounds_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	unsigned long rounds;
+	int err;
+
+	err = strict_strtoul(buf, 10, &rounds);
+	if (err || rounds > USHRT_MAX)
+		return -EINVAL;
+
+	ksm_max_skip_rounds = rounds;
+
+	return count;
+}
+KSM_ATTR(max_skip_rounds);
+
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
@@ -1877,8 +2186,9 @@ static ssize_t pages_volatile_show(struct kobject *kobj,
 {
 	long ksm_pages_volatile;
 
-	ksm_pages_volatile = ksm_rmap_items - ksm_pages_shared
-				- ksm_pages_sharing - ksm_pages_unshared;
+	ksm_pages_volatile = atomic_long_read(&ksm_rmap_items)
+				- ksm_pages_shared - ksm_pages_sharing
+				- ksm_pages_unshared;
 	/*
 	 * It was not worth any locking to calculate that statistic,
 	 * but it might therefore sometimes be negative: conceal that.
@@ -1892,19 +2202,47 @@ KSM_ATTR_RO(pages_volatile);
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_scan.seqnr);
+	return sprintf(buf, "%lu\n", ksm_scan_seqnr);
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	unsigned long pages_scanned = 0;
+	int i;
+
+	for (i = 0; i < KSM_MAX_THREADS; i++)
+		pages_scanned += ksm_threads[i].scan.pages_scanned;
+	return sprintf(buf, "%lu\n", pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	unsigned long pages_skipped = 0;
+	int i;
+
+	for (i = 0; i < KSM_MAX_THREADS; i++)
+		pages_skipped += ksm_threads[i].scan.pages_skipped;
+	return sprintf(buf, "%lu\n", pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
 	&run_attr.attr,
+	&nr_threads_attr.attr,
+	&max_skip_rounds_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_skipped_attr.attr,
 	NULL,
 };
 
@@ -1916,25 +2254,21 @@ static struct attribute_group ksm_attr_group = {
 
 static int __init ksm_init(void)
 {
-	struct task_struct *ksm_thread;
 	int err;
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
-	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
-	if (IS_ERR(ksm_thread)) {
-		printk(KERN_ERR "ksm: creating kthread failed\n");
-		err = PTR_ERR(ksm_thread);
+	err = ksm_start_thread(0);
+	if (err)
 		goto out_free;
-	}
 
 #ifdef CONFIG_SYSFS
 	err = sysfs_create_group(mm_kobj, &ksm_attr_group);
 	if (err) {
 		printk(KERN_ERR "ksm: register sysfs failed\n");
-		kthread_stop(ksm_thread);
+		ksm_stop_thread(0);
 		goto out_free;
 	}
 #else
@@ -1944,7 +2278,7 @@ static int __init ksm_init(void)
 
 #ifdef CONFIG_MEMORY_HOTREMOVE
 	/*
-	 * Choose a high priority since the callback takes ksm_thread_mutex:
+	 * Choose a high priority since the callback takes ksm_thread_sem:
 	 * later callbacks could only be taking locks which nest within that.
 	 */
 	hotplug_memory_notifier(ksm_memory_callback, 100);
@@ -33,18 +33,28 @@ static int walk_pmd_range(pud_t *pud, unsigned long addr, unsigned long end,
 
 	pmd = pmd_offset(pud, addr);
 	do {
+again:
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd)) {
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd) &&
+		    !pmd_trans_huge(*pmd)) {
 			if (walk->pte_hole)
 				err = walk->pte_hole(addr, next, walk);
 			if (err)
 				break;
 			continue;
 		}
+		/*
+		 * ->pmd_entry() also sees transparent huge pmds and has
+		 * to handle them itself, ->pte_entry() needs them split.
+		 */
 		if (walk->pmd_entry)
 			err = walk->pmd_entry(pmd, addr, next, walk);
-		if (!err && walk->pte_entry)
+		if (!err && walk->pte_entry) {
+			split_huge_pmd(walk->mm, pmd, addr);
+			if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+				goto again;
 			err = walk_pte_range(pmd, addr, next, walk);
+		}
 		if (err)
 			break;
 	} while (pmd++, addr = next, addr != end);
@@ -31,11 +31,12 @@
  *             swap_lock (in swap_duplicate, swap_info_get)
  *               mmlist_lock (in mmput, drain_mmlist and others)
  *               mapping->private_lock (in __set_page_dirty_buffers)
- *               inode_lock (in set_page_dirty's __mark_inode_dirty)
- *                 sb_lock (within inode_lock in fs/fs-writeback.c)
+ *               inode->i_lock (in set_page_dirty's __mark_inode_dirty)
+ *               inode_wb_list_lock (in set_page_dirty's __mark_inode_dirty)
+ *                 sb_lock (within inode_wb_list_lock in fs/fs-writeback.c)
  *                 mapping->tree_lock (widely used, in set_page_dirty,
  *                           in arch-dependent flush_dcache_mmap_lock,
- *                           within inode_lock in __sync_single_inode)
+ *                           within inode_wb_list_lock in __sync_single_inode)
  *
  * (code doesn't rely on that order so it could be switched around)
  * ->tasklist_lock
@@ -431,6 +432,8 @@ pte_t *page_check_address(struct page *page, struct mm_struct *mm,
 		return NULL;
 
 	pmd = pmd_offset(pud, address);
+	/* the caller wants a pte: break down a transparent huge pmd */
+	split_huge_pmd(mm, pmd, address);
 	if (!pmd_present(*pmd))
 		return NULL;
 
@@ -489,8 +492,26 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 	struct mm_struct *mm = vma->vm_mm;
 	pte_t *pte;
 	spinlock_t *ptl;
-	int referenced = 0;
+	int referenced;
+
+	/*
+	 * Look at a transparent huge pmd without splitting it, which
+	 * page_check_address() would do: only reclaim needs to do that.
+	 */
+	referenced = huge_pmd_referenced(page, vma, address);
+	if (referenced >= 0) {
+		if (vma->vm_flags & VM_LOCKED) {
+			*mapcount = 1;	/* break early from loop */
+			*vm_flags |= VM_LOCKED;
+			return 0;
+		}
+		if (VM_SequentialReadHint(vma))
+			referenced = 0;
+		(*mapcount)--;
+		goto out;
+	}
 
+	referenced = 0;
 	pte = page_check_address(page, mm, address, &ptl, 0);
 	if (!pte)
 		goto out;
@@ -527,10 +548,9 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 out_unmap:
 	(*mapcount)--;
 	pte_unmap_unlock(pte, ptl);
-
+out:
 	if (referenced)
 		*vm_flags |= vma->vm_flags;
-out:
 	return referenced;
 }
 
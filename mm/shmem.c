@@ -60,6 +60,7 @@ static struct vfsmount *shm_mnt;
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
+#include <linux/falloc.h>
 
 #include <asm/uaccess.h>
 #include <asm/div64.h>
@@ -819,6 +820,90 @@ static int shmem_notify_change(struct dentry *dentry, struct iattr *attr)
 	return error;
 }
 
+/*
+ * Zero the part of page @idx from @from to @to, if that page is present:
+ * a hole in the file already reads back as zeroes.
+ */
+static int shmem_zero_partial_page(struct inode *inode, unsigned long idx,
+				   unsigned from, unsigned to)
+{
+	struct page *page = NULL;
+	int error;
+
+	error = shmem_getpage(inode, idx, &page, SGP_READ, NULL);
+	if (error || !page)
+		return error;
+	zero_user(page, from, to - from);
+	set_page_dirty(page);
+	unlock_page(page);
+	page_cache_release(page);
+	return 0;
+}
+
+/*
+ * Only hole punching is supported: tmpfs does not preallocate.  Partial
+ * pages at either end are zeroed in place, whole pages are dropped from
+ * the page cache and swap just as for madvise(MADV_REMOVE).
+ */
+static long shmem_fallocate(struct inode *inode, int mode,
+			    loff_t offset, loff_t len)
+{
+	struct address_space *mapping = inode->i_mapping;
+	loff_t end = offset + len;
+	loff_t hole_start, hole_end;
+	int error = 0;
+
+	if (mode != (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE))
+		return -EOPNOTSUPP;
+
+	mutex_lock(&inode->i_mutex);
+	if (end > inode->i_size)
+		end = inode->i_size;
+	if (offset >= end)
+		goto out;
+
+	hole_start = round_up(offset, PAGE_CACHE_SIZE);
+	hole_end = round_down(end, PAGE_CACHE_SIZE);
+
+	if (hole_start > hole_end) {
+		/* the whole range lies within a single page */
+		error = shmem_zero_partial_page(inode,
+				offset >> PAGE_CACHE_SHIFT,
+				offset & ~PAGE_CACHE_MASK,
+				end - (offset & PAGE_CACHE_MASK));
+		goto out_time;
+	}
+	if (offset < hole_start) {
+		error = shmem_zero_partial_page(inode,
+				offset >> PAGE_CACHE_SHIFT,
+				offset & ~PAGE_CACHE_MASK, PAGE_CACHE_SIZE);
+		if (error)
+			goto out;
+	}
+	if (end > hole_end) {
+		error = shmem_zero_partial_page(inode,
+				hole_end >> PAGE_CACHE_SHIFT,
+				0, end - hole_end);
+		if (error)
+			goto out;
+	}
+	if (hole_start < hole_end) {
+		down_write(&inode->i_alloc_sem);
+		unmap_mapping_range(mapping, hole_start,
+				    hole_end - hole_start, 1);
+		truncate_inode_pages_range(mapping, hole_start, hole_end - 1);
+		unmap_mapping_range(mapping, hole_start,
+				    hole_end - hole_start, 1);
+		shmem_truncate_range(inode, hole_start, hole_end - 1);
+		up_write(&inode->i_alloc_sem);
+	}
+out_time:
+	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
+out:
+	mutex_unlock(&inode->i_mutex);
+	return error;
+}
+
 static void shmem_evict_inode(struct inode *inode)
 {
 	struct shmem_inode_info *info = SHMEM_I(inode);
@@ -2414,13 +2499,19 @@ static struct inode *shmem_alloc_inode(struct super_block *sb)
 	return &p->vfs_inode;
 }
 
+static void shmem_i_callback(struct rcu_head *head)
+{
+	struct inode *inode = container_of(head, struct inode, i_rcu);
+	kmem_cache_free(shmem_inode_cachep, SHMEM_I(inode));
+}
+
 static void shmem_destroy_inode(struct inode *inode)
 {
 	if ((inode->i_mode & S_IFMT) == S_IFREG) {
 		/* only struct inode is valid if it's an inline symlink */
 		mpol_free_shared_policy(&SHMEM_I(inode)->policy);
 	}
-	kmem_cache_free(shmem_inode_cachep, SHMEM_I(inode));
+	call_rcu(&inode->i_rcu, shmem_i_callback);
 }
 
 static void init_once(void *foo)
@@ -2472,6 +2563,7 @@ static const struct file_operations shmem_file_operations = {
 static const struct inode_operations shmem_inode_operations = {
 	.setattr	= shmem_notify_change,
 	.truncate_range	= shmem_truncate_range,
+	.fallocate	= shmem_fallocate,
 #ifdef CONFIG_TMPFS_POSIX_ACL
 	.setxattr	= generic_setxattr,
 	.getxattr	= generic_getxattr,
@@ -2548,6 +2640,7 @@ static struct file_system_type tmpfs_fs_type = {
 	.name		= "tmpfs",
 	.get_sb		= shmem_get_sb,
 	.kill_sb	= kill_litter_super,
+	.fs_flags	= FS_RCU_INODES,
 };
 
 int __init init_tmpfs(void)
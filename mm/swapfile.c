@@ -35,6 +35,7 @@
 #include <asm/tlbflush.h>
 #include <linux/swapops.h>
 #include <linux/page_cgroup.h>
+#include <linux/zswap.h>
 
 static bool swap_count_continued(struct swap_info_struct *, pgoff_t,
 				 unsigned char);
@@ -207,6 +208,226 @@ static int wait_for_discard(void *word)
 #define SWAPFILE_CLUSTER	256
 #define LATENCY_LIMIT		256
 
+/*
+ * On SSD swap, each cpu reserves a whole free cluster and then hands out
+ * its slots one by one, so that reclaim on many cpus neither scans the
+ * swap_map under swap_lock nor interleaves its slots. Reserved slots are
+ * marked SWAP_MAP_RESERVED and accounted as in use, so the rest of the
+ * swap code leaves them alone. swapoff clears SWP_WRITEOK before taking
+ * back the slots that were not handed out.
+ */
+struct percpu_cluster {
+	int type;		/* swap area the cluster belongs to */
+	unsigned int next;	/* next slot to hand out */
+	unsigned int nr;	/* reserved slots left */
+};
+
+static DEFINE_PER_CPU(struct percpu_cluster, swap_percpu_cluster);
+
+static inline struct swap_cluster_info *
+swap_cluster(struct swap_info_struct *si, unsigned long offset)
+{
+	return &si->cluster_info[offset / SWAPFILE_CLUSTER];
+}
+
+/* A free slot got used: called with swap_lock held */
+static inline void swap_cluster_inc(struct swap_info_struct *si,
+				    unsigned long offset)
+{
+	struct swap_cluster_info *ci;
+
+	if (!si->cluster_info)
+		return;
+	ci = swap_cluster(si, offset);
+	if (!ci->count++)
+		list_del_init(&ci->list);
+}
+
+/* A slot became free: called with swap_lock held */
+static inline void swap_cluster_dec(struct swap_info_struct *si,
+				    unsigned long offset)
+{
+	struct swap_cluster_info *ci;
+
+	if (!si->cluster_info)
+		return;
+	ci = swap_cluster(si, offset);
+	VM_BUG_ON(!ci->count);
+	if (!--ci->count)
+		list_add_tail(&ci->list, &si->free_clusters);
+}
+
+/*
+ * Take the oldest free cluster of @si and mark all its slots reserved.
+ * Returns the offset of its first slot, or 0 if there is none.
+ * Called with swap_lock held.
+ */
+static unsigned long swap_reserve_cluster(struct swap_info_struct *si)
+{
+	struct swap_cluster_info *ci;
+	unsigned long offset, end;
+
+	if (list_empty(&si->free_clusters))
+		return 0;
+
+	ci = list_first_entry(&si->free_clusters,
+			      struct swap_cluster_info, list);
+	list_del_init(&ci->list);
+	ci->count = SWAPFILE_CLUSTER;
+
+	offset = (ci - si->cluster_info) * SWAPFILE_CLUSTER;
+	end = offset + SWAPFILE_CLUSTER;
+	memset(si->swap_map + offset, SWAP_MAP_RESERVED, SWAPFILE_CLUSTER);
+
+	si->inuse_pages += SWAPFILE_CLUSTER;
+	nr_swap_pages -= SWAPFILE_CLUSTER;
+	if (si->inuse_pages == si->pages) {
+		si->lowest_bit = si->max;
+		si->highest_bit = 0;
+	} else {
+		if (si->lowest_bit >= offset && si->lowest_bit < end)
+			si->lowest_bit = end;
+		if (si->highest_bit >= offset && si->highest_bit < end)
+			si->highest_bit = offset - 1;
+	}
+	return offset;
+}
+
+/*
+ * Give back @nr reserved slots from @offset that were never handed out.
+ * Called with swap_lock held.
+ */
+static void swap_release_reserved(struct swap_info_struct *si,
+				  unsigned long offset, unsigned int nr)
+{
+	for (; nr; nr--, offset++) {
+		VM_BUG_ON(si->swap_map[offset] != SWAP_MAP_RESERVED);
+		si->swap_map[offset] = 0;
+		if (offset < si->lowest_bit)
+			si->lowest_bit = offset;
+		if (offset > si->highest_bit)
+			si->highest_bit = offset;
+		nr_swap_pages++;
+		si->inuse_pages--;
+		swap_cluster_dec(si, offset);
+	}
+}
+
+/*
+ * Make the cluster reserved at @offset, whose first slot our caller keeps,
+ * this cpu's source of swap slots. The old contents of the cluster are
+ * discarded first if the device asks for it: nothing else can allocate
+ * from the cluster meanwhile, so the discard never races with a write.
+ * Called without swap_lock, with SWP_SCANNING held on @si to keep swapoff
+ * from freeing the swap_map under us.
+ */
+static void swap_install_cluster(struct swap_info_struct *si,
+				 unsigned long offset)
+{
+	struct percpu_cluster *pc;
+
+	if (si->flags & SWP_DISCARDABLE)
+		discard_swap_cluster(si, offset, SWAPFILE_CLUSTER);
+
+	spin_lock(&swap_lock);
+	pc = &__get_cpu_var(swap_percpu_cluster);
+	if (!pc->nr && (si->flags & SWP_WRITEOK)) {
+		pc->type = si->type;
+		pc->next = offset + 1;
+		pc->nr = SWAPFILE_CLUSTER - 1;
+	} else {
+		/* We slept in discard: this cpu has another cluster by now,
+		 * or swapoff began and already drained the per-cpu clusters */
+		swap_release_reserved(si, offset + 1, SWAPFILE_CLUSTER - 1);
+	}
+	si->flags -= SWP_SCANNING;
+	spin_unlock(&swap_lock);
+}
+
+/*
+ * Fast path of get_swap_page(): no scan, just the next slot of this cpu's
+ * cluster.  swap_lock is still taken, since other cpus store to
+ * neighbouring bytes of the swap_map, which not every architecture can
+ * do atomically.
+ */
+static swp_entry_t get_swap_page_percpu(void)
+{
+	struct percpu_cluster *pc;
+	struct swap_info_struct *si;
+	swp_entry_t entry = { 0 };
+
+	pc = &get_cpu_var(swap_percpu_cluster);
+	if (pc->nr) {
+		si = swap_info[pc->type];
+		spin_lock(&swap_lock);
+		/* swapoff may have drained the cluster meanwhile */
+		if (pc->nr && likely(si->flags & SWP_WRITEOK)) {
+			si->swap_map[pc->next] = SWAP_HAS_CACHE;
+			entry = swp_entry(pc->type, pc->next);
+			pc->next++;
+			pc->nr--;
+		}
+		spin_unlock(&swap_lock);
+	}
+	put_cpu_var(swap_percpu_cluster);
+	return entry;
+}
+
+/*
+ * swapoff has cleared SWP_WRITEOK on @si: take back what the per-cpu
+ * clusters had not handed out.
+ */
+static void swap_drain_percpu_clusters(struct swap_info_struct *si)
+{
+	int cpu;
+
+	if (!si->cluster_info)
+		return;
+
+	spin_lock(&swap_lock);
+	for_each_possible_cpu(cpu) {
+		struct percpu_cluster *pc = &per_cpu(swap_percpu_cluster, cpu);
+
+		if (pc->nr && pc->type == si->type) {
+			swap_release_reserved(si, pc->next, pc->nr);
+			pc->nr = 0;
+		}
+	}
+	spin_unlock(&swap_lock);
+}
+
+/*
+ * Set up the cluster usage counts of an SSD swap area from its swap_map.
+ * Slots past the end of the area count as used, so the last cluster is
+ * never handed out whole unless it is complete. Without memory for this,
+ * the area just does without per-cpu clusters.
+ */
+static void setup_swap_clusters(struct swap_info_struct *p,
+				unsigned char *swap_map)
+{
+	unsigned long nr_clusters = DIV_ROUND_UP(p->max, SWAPFILE_CLUSTER);
+	struct swap_cluster_info *ci;
+	unsigned long i, j;
+
+	INIT_LIST_HEAD(&p->free_clusters);
+	p->cluster_info = vmalloc(nr_clusters * sizeof(*ci));
+	if (!p->cluster_info)
+		return;
+
+	for (i = 0; i < nr_clusters; i++) {
+		ci = &p->cluster_info[i];
+		INIT_LIST_HEAD(&ci->list);
+		ci->count = 0;
+		for (j = i * SWAPFILE_CLUSTER;
+		     j < (i + 1) * SWAPFILE_CLUSTER; j++) {
+			if (j >= p->max || swap_map[j])
+				ci->count++;
+		}
+		if (!ci->count)
+			list_add_tail(&ci->list, &p->free_clusters);
+	}
+}
+
 static inline unsigned long scan_swap_map(struct swap_info_struct *si,
 					  unsigned char usage)
 {
@@ -340,6 +561,7 @@ checks:
 		si->highest_bit = 0;
 	}
 	si->swap_map[offset] = usage;
+	swap_cluster_inc(si, offset);
 	si->cluster_next = offset + 1;
 	si->flags -= SWP_SCANNING;
 
@@ -439,10 +661,15 @@ no_page:
 swp_entry_t get_swap_page(void)
 {
 	struct swap_info_struct *si;
+	swp_entry_t entry;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
 
+	entry = get_swap_page_percpu();
+	if (entry.val)
+		return entry;
+
 	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
 		goto noswap;
@@ -463,6 +690,21 @@ swp_entry_t get_swap_page(void)
 			continue;
 
 		swap_list.next = next;
+
+		/* Start a new per-cpu cluster if this cpu has none left */
+		if (si->cluster_info && !__get_cpu_var(swap_percpu_cluster).nr) {
+			offset = swap_reserve_cluster(si);
+			if (offset) {
+				/* the cluster accounted for our page too */
+				nr_swap_pages++;
+				si->swap_map[offset] = SWAP_HAS_CACHE;
+				si->flags += SWP_SCANNING;
+				spin_unlock(&swap_lock);
+				swap_install_cluster(si, offset);
+				return swp_entry(type, offset);
+			}
+		}
+
 		/* This is called for allocating swap entry for cache */
 		offset = scan_swap_map(si, SWAP_HAS_CACHE);
 		if (offset) {
@@ -584,6 +826,8 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 			swap_list.next = p->type;
 		nr_swap_pages++;
 		p->inuse_pages--;
+		swap_cluster_dec(p, offset);
+		zswap_invalidate_page(p->type, offset);
 		if ((p->flags & SWP_BLKDEV) &&
 				disk->fops->swap_slot_free_notify)
 			disk->fops->swap_slot_free_notify(p->bdev, offset);
@@ -959,7 +1203,7 @@ static inline int unuse_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd))
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
 		ret = unuse_pte_range(vma, pmd, addr, next, entry, page);
 		if (ret)
@@ -1547,6 +1791,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 {
 	struct swap_info_struct *p = NULL;
 	unsigned char *swap_map;
+	struct swap_cluster_info *cluster_info;
 	struct file *swap_file, *victim;
 	struct address_space *mapping;
 	struct inode *inode;
@@ -1609,6 +1854,8 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	swap_drain_percpu_clusters(p);
+
 	current->flags |= PF_OOM_ORIGIN;
 	err = try_to_unuse(type);
 	current->flags &= ~PF_OOM_ORIGIN;
@@ -1661,10 +1908,14 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->max = 0;
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
+	cluster_info = p->cluster_info;
+	p->cluster_info = NULL;
 	p->flags = 0;
 	spin_unlock(&swap_lock);
+	zswap_invalidate_area(type);
 	mutex_unlock(&swapon_mutex);
 	vfree(swap_map);
+	vfree(cluster_info);
 	/* Destroy swap account informatin */
 	swap_cgroup_swapoff(type);
 
@@ -2046,6 +2297,7 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 		if (blk_queue_nonrot(bdev_get_queue(p->bdev))) {
 			p->flags |= SWP_SOLIDSTATE;
 			p->cluster_next = 1 + (random32() % p->highest_bit);
+			setup_swap_clusters(p, swap_map);
 		}
 		if (discard_swap(p) == 0 && (swap_flags & SWAP_FLAG_DISCARD))
 			p->flags |= SWP_DISCARDABLE;
@@ -2166,6 +2418,11 @@ static int __swap_duplicate(swp_entry_t entry, unsigned char usage)
 		goto unlock_out;
 
 	count = p->swap_map[offset];
+	/* bad, or reserved in a per-cpu cluster and not yet handed out */
+	if (unlikely(swap_count(count) == SWAP_MAP_BAD)) {
+		err = -ENOENT;
+		goto unlock_out;
+	}
 	has_cache = count & SWAP_HAS_CACHE;
 	count &= ~SWAP_HAS_CACHE;
 	err = 0;
@@ -40,6 +40,7 @@
 #include <linux/memcontrol.h>
 #include <linux/delayacct.h>
 #include <linux/sysctl.h>
+#include <linux/compaction.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -2378,6 +2379,14 @@ static int kswapd(void *p)
 				 */
 				if (!sleeping_prematurely(pgdat, order, remaining)) {
 					trace_mm_vmscan_kswapd_sleep(pgdat->node_id);
+					/*
+					 * The watermarks are met, but a high
+					 * order request may still fail due to
+					 * fragmentation. Let kcompactd deal
+					 * with that in the background.
+					 */
+					wakeup_kcompactd(pgdat, order,
+							pgdat->nr_zones - 1);
 					schedule();
 				} else {
 					if (remaining)
@@ -2420,6 +2429,12 @@ void wakeup_kswapd(struct zone *zone, int order)
 	pgdat = zone->zone_pgdat;
 	if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0))
 		return;
+	/*
+	 * If the failure is due to fragmentation rather than low memory,
+	 * reclaim alone will not help; start compacting in the background.
+	 */
+	if (order)
+		wakeup_kcompactd(pgdat, order, zone_idx(zone));
 	if (pgdat->kswapd_max_order < order)
 		pgdat->kswapd_max_order = order;
 	trace_mm_vmscan_wakeup_kswapd(pgdat->node_id, zone_idx(zone), order);
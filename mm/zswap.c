@@ -0,0 +1,453 @@
+/*
+ * zswap - compressed cache for swap pages
+ *
+ * Anonymous pages that reclaim writes to swap are first offered to zswap
+ * by swap_writepage(). If the page compresses well and the pool has room,
+ * the compressed copy is kept in RAM, indexed by its swap slot, and the
+ * page is completed without any I/O. swap_readpage() then decompresses
+ * it back in microseconds instead of waiting for the swap device. Pages
+ * zswap rejects (pool full, poor compression, no memory) are written to
+ * the swap device as before.
+ *
+ * An entry lives as long as its swap slot: it is dropped when the slot is
+ * freed, when the page is written to the same slot again, or at swapoff.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/rbtree.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/crypto.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/zswap.h>
+
+/*
+ * Tunables
+ */
+
+/* Enable/disable zswap; entries already stored stay readable. */
+static int zswap_enabled = 1;
+module_param_named(enabled, zswap_enabled, bool, 0644);
+
+/* Crypto API compression algorithm, fixed at boot */
+#define ZSWAP_COMPRESSOR_DEFAULT "lzo"
+static char zswap_compressor[CRYPTO_MAX_ALG_NAME] = ZSWAP_COMPRESSOR_DEFAULT;
+module_param_string(compressor, zswap_compressor, sizeof(zswap_compressor),
+		    0444);
+
+/* The pool may use at most this percentage of RAM */
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/* Pages compressing to more than this are not worth keeping */
+static unsigned int zswap_max_compressed_size = PAGE_SIZE / 4 * 3;
+
+/*
+ * Statistics
+ */
+static atomic_long_t zswap_pool_bytes = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_stored_pages = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_loads = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_reject_pool_limit = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_reject_compress_poor = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_reject_alloc_fail = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_duplicate_entry = ATOMIC_LONG_INIT(0);
+
+/*
+ * Data structures
+ */
+
+struct zswap_entry {
+	struct rb_node rbnode;
+	pgoff_t offset;
+	unsigned int length;	/* compressed length */
+	void *data;
+};
+
+/* One tree per swap type, keyed by swap offset */
+struct zswap_tree {
+	struct rb_root rbroot;
+	spinlock_t lock;	/* protects rbroot and its entries */
+};
+
+static struct zswap_tree zswap_trees[MAX_SWAPFILES];
+static struct kmem_cache *zswap_entry_cache;
+
+/*
+ * Compression runs with preemption disabled on the local CPU's transform
+ * and output buffer, so stores on different CPUs never contend.
+ */
+static DEFINE_PER_CPU(struct crypto_comp *, zswap_tfm);
+static DEFINE_PER_CPU(u8 *, zswap_dstmem);
+
+static bool zswap_initialized;
+
+/*
+ * Helpers
+ */
+
+static bool zswap_is_full(void)
+{
+	unsigned long limit = totalram_pages * zswap_max_pool_percent / 100;
+
+	return atomic_long_read(&zswap_pool_bytes) >> PAGE_SHIFT >= limit;
+}
+
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (offset < entry->offset)
+			node = node->rb_left;
+		else if (offset > entry->offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Insert @entry, returning the entry it displaced for the same offset
+ * (if any) so that the caller can free it.
+ */
+static struct zswap_entry *zswap_rb_insert(struct rb_root *root,
+					   struct zswap_entry *entry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *myentry;
+
+	while (*link) {
+		parent = *link;
+		myentry = rb_entry(parent, struct zswap_entry, rbnode);
+		if (entry->offset < myentry->offset)
+			link = &parent->rb_left;
+		else if (entry->offset > myentry->offset)
+			link = &parent->rb_right;
+		else {
+			rb_replace_node(&myentry->rbnode, &entry->rbnode,
+					root);
+			return myentry;
+		}
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+	return NULL;
+}
+
+static void zswap_free_entry(struct zswap_entry *entry)
+{
+	atomic_long_sub(ksize(entry->data), &zswap_pool_bytes);
+	atomic_long_dec(&zswap_stored_pages);
+	kfree(entry->data);
+	kmem_cache_free(zswap_entry_cache, entry);
+}
+
+/*
+ * Swap hooks
+ */
+
+/*
+ * Try to store @page, which is locked and in the swap cache, in the
+ * compressed pool. Returns 0 if the page was stored and needs no I/O,
+ * or a negative errno if it must be written to the swap device.
+ */
+int zswap_store(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page), };
+	struct zswap_tree *tree = &zswap_trees[swp_type(swp)];
+	struct zswap_entry *entry, *dupentry;
+	struct crypto_comp *tfm;
+	unsigned int dlen = PAGE_SIZE << 1;
+	u8 *src, *dst;
+	int ret;
+
+	if (!zswap_initialized || !zswap_enabled) {
+		ret = -EPERM;
+		goto reject;
+	}
+
+	if (zswap_is_full()) {
+		atomic_long_inc(&zswap_reject_pool_limit);
+		ret = -ENOMEM;
+		goto reject;
+	}
+
+	/*
+	 * We are called from reclaim: never sleep, retry or dip into the
+	 * emergency reserves, just fall back to the swap device.
+	 */
+	entry = kmem_cache_alloc(zswap_entry_cache,
+				 __GFP_NORETRY | __GFP_NOWARN |
+				 __GFP_NOMEMALLOC);
+	if (!entry) {
+		atomic_long_inc(&zswap_reject_alloc_fail);
+		ret = -ENOMEM;
+		goto reject;
+	}
+
+	tfm = get_cpu_var(zswap_tfm);
+	dst = __get_cpu_var(zswap_dstmem);
+	src = kmap_atomic(page, KM_USER0);
+	ret = crypto_comp_compress(tfm, src, PAGE_SIZE, dst, &dlen);
+	kunmap_atomic(src, KM_USER0);
+	if (ret) {
+		ret = -EINVAL;
+		goto put_dstmem;
+	}
+
+	if (dlen > zswap_max_compressed_size) {
+		atomic_long_inc(&zswap_reject_compress_poor);
+		ret = -E2BIG;
+		goto put_dstmem;
+	}
+
+	entry->data = kmalloc(dlen, __GFP_NORETRY | __GFP_NOWARN |
+				    __GFP_NOMEMALLOC);
+	if (!entry->data) {
+		atomic_long_inc(&zswap_reject_alloc_fail);
+		ret = -ENOMEM;
+		goto put_dstmem;
+	}
+	memcpy(entry->data, dst, dlen);
+	put_cpu_var(zswap_tfm);
+
+	entry->offset = swp_offset(swp);
+	entry->length = dlen;
+	atomic_long_add(ksize(entry->data), &zswap_pool_bytes);
+	atomic_long_inc(&zswap_stored_pages);
+
+	spin_lock(&tree->lock);
+	dupentry = zswap_rb_insert(&tree->rbroot, entry);
+	spin_unlock(&tree->lock);
+	if (dupentry) {
+		/* The page was dirtied and written to the same slot again */
+		atomic_long_inc(&zswap_duplicate_entry);
+		zswap_free_entry(dupentry);
+	}
+	return 0;
+
+put_dstmem:
+	put_cpu_var(zswap_tfm);
+	kmem_cache_free(zswap_entry_cache, entry);
+reject:
+	/* An older copy of this slot must not shadow what goes to disk */
+	zswap_invalidate_page(swp_type(swp), swp_offset(swp));
+	return ret;
+}
+
+/*
+ * Fill @page, which is locked and in the swap cache, from the compressed
+ * pool. Returns 0 on success, or -ENOENT if the slot is not in the pool
+ * and must be read from the swap device.
+ */
+int zswap_load(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page), };
+	struct zswap_tree *tree = &zswap_trees[swp_type(swp)];
+	struct zswap_entry *entry;
+	unsigned int dlen = PAGE_SIZE;
+	u8 *dst;
+	int ret;
+
+	if (!zswap_initialized)
+		return -ENOENT;
+
+	/*
+	 * Decompress under the tree lock so the entry cannot be freed under
+	 * us; it is short and does not sleep.
+	 */
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, swp_offset(swp));
+	if (!entry) {
+		spin_unlock(&tree->lock);
+		return -ENOENT;
+	}
+
+	dst = kmap_atomic(page, KM_USER0);
+	ret = crypto_comp_decompress(get_cpu_var(zswap_tfm), entry->data,
+				     entry->length, dst, &dlen);
+	put_cpu_var(zswap_tfm);
+	kunmap_atomic(dst, KM_USER0);
+	spin_unlock(&tree->lock);
+
+	/* Only a corrupted pool could get here */
+	BUG_ON(ret || dlen != PAGE_SIZE);
+
+	atomic_long_inc(&zswap_loads);
+	flush_dcache_page(page);
+	return 0;
+}
+
+/* The swap slot was freed: drop its compressed copy, if any */
+void zswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct zswap_entry *entry;
+
+	if (!zswap_initialized)
+		return;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (entry)
+		rb_erase(&entry->rbnode, &tree->rbroot);
+	spin_unlock(&tree->lock);
+
+	if (entry)
+		zswap_free_entry(entry);
+}
+
+/* The swap area is going away: drop everything stored for it */
+void zswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct zswap_entry *entry;
+	struct rb_node *node;
+
+	if (!zswap_initialized)
+		return;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot))) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		rb_erase(node, &tree->rbroot);
+		zswap_free_entry(entry);
+	}
+	spin_unlock(&tree->lock);
+}
+
+/*
+ * debugfs
+ */
+#ifdef CONFIG_DEBUG_FS
+static int zswap_stats_show(struct seq_file *m, void *v)
+{
+	seq_printf(m,
+		   "stored_pages:         %10ld\n"
+		   "pool_bytes:           %10ld\n"
+		   "loads:                %10ld\n"
+		   "reject_pool_limit:    %10ld\n"
+		   "reject_compress_poor: %10ld\n"
+		   "reject_alloc_fail:    %10ld\n"
+		   "duplicate_entry:      %10ld\n",
+		   atomic_long_read(&zswap_stored_pages),
+		   atomic_long_read(&zswap_pool_bytes),
+		   atomic_long_read(&zswap_loads),
+		   atomic_long_read(&zswap_reject_pool_limit),
+		   atomic_long_read(&zswap_reject_compress_poor),
+		   atomic_long_read(&zswap_reject_alloc_fail),
+		   atomic_long_read(&zswap_duplicate_entry));
+	return 0;
+}
+
+static int zswap_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zswap_stats_show, NULL);
+}
+
+static const struct file_operations zswap_stats_fops = {
+	.open		= zswap_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void __init zswap_debugfs_init(void)
+{
+	struct dentry *root;
+
+	root = debugfs_create_dir("zswap", NULL);
+	if (root)
+		debugfs_create_file("stats", 0444, root, NULL,
+				    &zswap_stats_fops);
+}
+#else
+static inline void zswap_debugfs_init(void)
+{
+}
+#endif
+
+/*
+ * Init
+ */
+
+static void __init zswap_free_percpu(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm = per_cpu(zswap_tfm, cpu);
+
+		if (tfm && !IS_ERR(tfm))
+			crypto_free_comp(tfm);
+		per_cpu(zswap_tfm, cpu) = NULL;
+		free_pages((unsigned long)per_cpu(zswap_dstmem, cpu), 1);
+		per_cpu(zswap_dstmem, cpu) = NULL;
+	}
+}
+
+static int __init zswap_init(void)
+{
+	int i, cpu;
+
+	for (i = 0; i < MAX_SWAPFILES; i++) {
+		zswap_trees[i].rbroot = RB_ROOT;
+		spin_lock_init(&zswap_trees[i].lock);
+	}
+
+	if (!crypto_has_comp(zswap_compressor, 0, 0)) {
+		pr_info("zswap: %s compressor not available, using %s\n",
+			zswap_compressor, ZSWAP_COMPRESSOR_DEFAULT);
+		strlcpy(zswap_compressor, ZSWAP_COMPRESSOR_DEFAULT,
+			sizeof(zswap_compressor));
+	}
+
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	if (!zswap_entry_cache)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm;
+		u8 *dst;
+
+		tfm = crypto_alloc_comp(zswap_compressor, 0, 0);
+		if (IS_ERR(tfm))
+			goto free_percpu;
+		per_cpu(zswap_tfm, cpu) = tfm;
+
+		/* 2 pages: compressed output can be larger than a page */
+		dst = (u8 *)__get_free_pages(GFP_KERNEL, 1);
+		if (!dst)
+			goto free_percpu;
+		per_cpu(zswap_dstmem, cpu) = dst;
+	}
+
+	zswap_debugfs_init();
+	zswap_initialized = true;
+	pr_info("zswap: using %s compressor\n", zswap_compressor);
+	return 0;
+
+free_percpu:
+	zswap_free_percpu();
+	kmem_cache_destroy(zswap_entry_cache);
+fail:
+	pr_err("zswap: initialization failed, disabled\n");
+	return -ENOMEM;
+}
+/* must be late so crypto has time to come up */
+late_initcall(zswap_init);
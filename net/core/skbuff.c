@@ -340,6 +340,18 @@ static void skb_release_data(struct sk_buff *skb)
 				put_page(skb_shinfo(skb)->frags[i].page);
 		}
 
+		/*
+		 * If the frags came from userspace, tell their owner that
+		 * the lower device is done with them.
+		 */
+		if (skb_shinfo(skb)->tx_flags.dev_zerocopy) {
+			struct ubuf_info *uarg;
+
+			uarg = skb_shinfo(skb)->destructor_arg;
+			if (uarg->callback)
+				uarg->callback(uarg);
+		}
+
 		if (skb_has_frags(skb))
 			skb_drop_fraglist(skb);
 
@@ -605,6 +617,65 @@ struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src)
 }
 EXPORT_SYMBOL_GPL(skb_morph);
 
+/**
+ *	skb_copy_ubufs	-	copy userspace skb frags buffers to kernel
+ *	@skb: the skb to modify
+ *	@gfp_mask: allocation priority
+ *
+ *	This must be called on an skb with tx_flags.dev_zerocopy set.  It
+ *	replaces the user pages in the frags by private kernel copies and
+ *	releases the user buffers, so that the skb can be cloned or have its
+ *	frags shared without holding the sender's buffers any longer.
+ *
+ *	Returns 0 on success or a negative error code on failure to allocate
+ *	kernel memory to copy to, in which case the skb is unchanged.
+ */
+int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	int i;
+	int num_frags = skb_shinfo(skb)->nr_frags;
+	struct page *page, *head = NULL;
+	struct ubuf_info *uarg = skb_shinfo(skb)->destructor_arg;
+
+	for (i = 0; i < num_frags; i++) {
+		u8 *vaddr;
+		skb_frag_t *f = &skb_shinfo(skb)->frags[i];
+
+		page = alloc_page(gfp_mask);
+		if (!page) {
+			while (head) {
+				struct page *next = (struct page *)head->private;
+				put_page(head);
+				head = next;
+			}
+			return -ENOMEM;
+		}
+		vaddr = kmap_skb_frag(f);
+		memcpy(page_address(page), vaddr + f->page_offset, f->size);
+		kunmap_skb_frag(vaddr);
+		page->private = (unsigned long)head;
+		head = page;
+	}
+
+	/* skb frags release userspace buffers */
+	for (i = 0; i < num_frags; i++)
+		put_page(skb_shinfo(skb)->frags[i].page);
+
+	uarg->callback(uarg);
+
+	/* skb frags point to kernel buffers */
+	for (i = num_frags - 1; i >= 0; i--) {
+		skb_shinfo(skb)->frags[i].page_offset = 0;
+		skb_shinfo(skb)->frags[i].page = head;
+		head = (struct page *)head->private;
+		skb_shinfo(skb)->frags[i].page->private = 0;
+	}
+
+	skb_shinfo(skb)->tx_flags.dev_zerocopy = 0;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(skb_copy_ubufs);
+
 /**
  *	skb_clone	-	duplicate an sk_buff
  *	@skb: buffer to clone
@@ -618,11 +689,15 @@ EXPORT_SYMBOL_GPL(skb_morph);
  *	If this function is called from an interrupt gfp_mask() must be
  *	%GFP_ATOMIC.
  */
-
 struct sk_buff *skb_clone(struct sk_buff *skb, gfp_t gfp_mask)
 {
 	struct sk_buff *n;
 
+	/* A clone would share the user frags beyond their completion. */
+	if (skb_shinfo(skb)->tx_flags.dev_zerocopy &&
+	    skb_copy_ubufs(skb, gfp_mask))
+		return NULL;
+
 	n = skb + 1;
 	if (skb->fclone == SKB_FCLONE_ORIG &&
 	    n->fclone == SKB_FCLONE_UNAVAILABLE) {
@@ -752,6 +827,12 @@ struct sk_buff *pskb_copy(struct sk_buff *skb, gfp_t gfp_mask)
 	if (skb_shinfo(skb)->nr_frags) {
 		int i;
 
+		if (skb_shinfo(skb)->tx_flags.dev_zerocopy &&
+		    skb_copy_ubufs(skb, gfp_mask)) {
+			kfree_skb(n);
+			n = NULL;
+			goto out;
+		}
 		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
 			skb_shinfo(n)->frags[i] = skb_shinfo(skb)->frags[i];
 			get_page(skb_shinfo(n)->frags[i].page);
@@ -805,6 +886,11 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 
 	size = SKB_DATA_ALIGN(size);
 
+	/* The old head is released below, and with it the user frags. */
+	if (skb_shinfo(skb)->tx_flags.dev_zerocopy &&
+	    skb_copy_ubufs(skb, gfp_mask))
+		goto nodata;
+
 	data = kmalloc(size + sizeof(struct skb_shared_info), gfp_mask);
 	if (!data)
 		goto nodata;
@@ -2513,6 +2599,11 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 	int i = 0;
 	int pos;
 
+	/* Segments take their own references on the frags. */
+	if (skb_shinfo(skb)->tx_flags.dev_zerocopy &&
+	    skb_copy_ubufs(skb, GFP_ATOMIC))
+		return ERR_PTR(-ENOMEM);
+
 	__skb_push(skb, doffset);
 	headroom = skb_headroom(skb);
 	pos = skb_headlen(skb);
@@ -158,6 +158,15 @@ static struct ctl_table net_core_table[] = {
 	},
 #endif
 #endif /* CONFIG_NET */
+#ifdef CONFIG_BPF_JIT
+	{
+		.procname	= "bpf_jit_enable",
+		.data		= &bpf_jit_enable,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec
+	},
+#endif
 	{
 		.procname	= "netdev_budget",
 		.data		= &netdev_budget,